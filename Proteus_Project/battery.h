@@ -0,0 +1,131 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <FEHBattery.h>
+
+#include "logRecords.h"
+#include "loopTimer.h"
+#include "runLog.h"
+#include "scheduler.h"
+
+// Battery voltage the motor equilibrium percentages hold at. Motor commands are scaled by this over the measured
+// voltage, so a calibration done on any pack works on any other.
+#define BATTERY_NOMINAL_VOLTS 11.5
+// Voltage sampling period, and how much of each new sample goes into the filtered voltage (time constant of
+// about half a second, so it follows the sag under load but not the spikes when a motor starts).
+#define BATTERY_SAMPLE_US 50000
+#define BATTERY_FILTER 0.1
+// Samples per LOG_BATTERY record (one a second).
+#define BATTERY_LOG_EVERY 20
+// Most a command gets scaled either way. Past this the reading is junk or the pack is flat anyway.
+#define BATTERY_MAX_SCALE 1.3
+
+/**
+ * @brief Keeps a filtered battery voltage up to date in the background, and scales motor commands by it.
+ *
+ * Motors turn at a speed proportional to the voltage they get, and a percent is a fraction of the battery
+ * voltage, so every hand tuned percent (the equilibrium, the line following corrections, open loop pushes) only
+ * holds at the voltage it was tuned at. compensate() scales a percent by BATTERY_NOMINAL_VOLTS over the filtered
+ * voltage, so a fresh pack and a tired one turn the wheels at the same speed. The voltage goes in the run log once
+ * a second (LOG_BATTERY), for a trace of the pack over the run.
+ *
+ * The following functions are included in the BatteryMonitor class:
+ * void start() - takes a first reading and starts sampling on the scheduler
+ * bool step() - samples and logs on schedule, called by the scheduler
+ * float scale() - how much motor commands are scaled by right now
+ * float compensate(float percent) - a motor percent scaled for the battery
+ */
+class BatteryMonitor : public Task
+{
+public:
+    // Filtered voltage, lowest filtered voltage seen, samples taken.
+    float volts, minVolts;
+    unsigned long samples;
+
+    BatteryMonitor(Scheduler &sched, RunLog &log)
+    {
+        scheduler = &sched;
+        runLog = &log;
+        volts = BATTERY_NOMINAL_VOLTS;
+        minVolts = BATTERY_NOMINAL_VOLTS;
+        samples = 0;
+        lastSample = BATTERY_NOMINAL_VOLTS;
+    }
+
+    /**
+     * @brief Starts the filter off at a fresh reading and keeps sampling in the background from then on.
+     */
+    void start()
+    {
+        lastSample = Battery.Voltage();
+        volts = lastSample;
+        minVolts = volts;
+        samples = 1;
+        timer.start(BATTERY_SAMPLE_US);
+        scheduler->start(this);
+    }
+
+    bool step()
+    {
+        if (timer.due())
+        {
+            lastSample = Battery.Voltage();
+            volts += BATTERY_FILTER * (lastSample - volts);
+            if (volts < minVolts)
+            {
+                minVolts = volts;
+            }
+            samples++;
+            if (samples % BATTERY_LOG_EVERY == 0)
+            {
+                runLog->add(LOG_BATTERY, 0, volts, lastSample, scale());
+            }
+            timer.done();
+        }
+        // Runs for the whole run.
+        return false;
+    }
+
+    /**
+     * @brief Factor motor percents are multiplied by at the current voltage.
+     */
+    float scale()
+    {
+        float factor = volts > 0.0 ? BATTERY_NOMINAL_VOLTS / volts : BATTERY_MAX_SCALE;
+        if (factor > BATTERY_MAX_SCALE)
+        {
+            return BATTERY_MAX_SCALE;
+        }
+        if (factor < 1.0 / BATTERY_MAX_SCALE)
+        {
+            return 1.0 / BATTERY_MAX_SCALE;
+        }
+        return factor;
+    }
+
+    /**
+     * @brief A motor percent scaled so it turns the motor as fast as it would at BATTERY_NOMINAL_VOLTS.
+     */
+    float compensate(float percent)
+    {
+        percent *= scale();
+        if (percent > 100.0)
+        {
+            return 100.0;
+        }
+        if (percent < -100.0)
+        {
+            return -100.0;
+        }
+        return percent;
+    }
+
+private:
+    Scheduler *scheduler;
+    RunLog *runLog;
+    LoopTimer timer;
+    // Last raw reading.
+    float lastSample;
+};
+
+#endif
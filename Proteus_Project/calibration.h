@@ -0,0 +1,97 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <FEHSD.h>
+#include <math.h>
+
+// File on the SD card the motor equilibrium is kept in.
+#define CALIBRATION_FILE "motorcal.txt"
+// Anything outside this (percent, either sign) is a bad calibration, a wheel off the ground or stuck on something.
+#define CALIBRATION_MIN_PERCENT 15.0
+#define CALIBRATION_MAX_PERCENT 95.0
+
+/**
+ * @brief Motor equilibrium percentages (what it takes for each wheel to turn at NOMINAL_TICK_RATE), kept on the SD
+ * card between runs so they only have to be measured when the battery or the carpet changes.
+ *
+ * Motion::calibrate() measures each wheel's tick rate at two percents. Wheel speed is close enough to a straight
+ * line in percent above the deadband, so two points give the percent for any speed, see solve().
+ *
+ * The following functions are included in the MotorCalibration class:
+ * bool load() - reads the file, false if there isn't one or it doesn't make sense
+ * bool save() - writes the file
+ * static float solve(float percentA, float rateA, float percentB, float rateB, float rate) - percent for a tick rate
+ * static bool sane(float percent) - whether a percent could be an equilibrium
+ */
+class MotorCalibration
+{
+public:
+    // Equilibrium percentages, with the same signs as LEFTPERCENT and RIGHTPERCENT.
+    float leftPercent, rightPercent;
+
+    MotorCalibration()
+    {
+        leftPercent = 0.0;
+        rightPercent = 0.0;
+    }
+
+    /**
+     * @brief Reads the last calibration off the card.
+     *
+     * @return false if there is no calibration file or what's in it can't be right
+     */
+    bool load()
+    {
+        FEHFile *file = SD.FOpen(CALIBRATION_FILE, "r");
+        if (file == NULL)
+        {
+            return false;
+        }
+        float left, right;
+        bool ok = SD.FScanf(file, "%f%f", &left, &right) == 2 && sane(left) && sane(right);
+        SD.FClose(file);
+        if (ok)
+        {
+            leftPercent = left;
+            rightPercent = right;
+        }
+        return ok;
+    }
+
+    /**
+     * @brief Writes the calibration to the card for the next run.
+     */
+    bool save()
+    {
+        FEHFile *file = SD.FOpen(CALIBRATION_FILE, "w");
+        if (file == NULL)
+        {
+            return false;
+        }
+        SD.FPrintf(file, "%f %f\n", leftPercent, rightPercent);
+        SD.FClose(file);
+        return true;
+    }
+
+    /**
+     * @brief Percent that makes a wheel turn at a tick rate, from the rates measured at two percents. The line
+     * through the two points takes care of the deadband, which a single point can't.
+     *
+     * @return the percent, with the same sign as the measured ones, or 0 if the two points don't give a line
+     */
+    static float solve(float percentA, float rateA, float percentB, float rateB, float rate)
+    {
+        if (rateA <= 0.0 || rateB <= 0.0 || fabs(rateB - rateA) < 0.5)
+        {
+            return 0.0;
+        }
+        return percentA + (percentB - percentA) * (rate - rateA) / (rateB - rateA);
+    }
+
+    static bool sane(float percent)
+    {
+        return fabs(percent) >= CALIBRATION_MIN_PERCENT && fabs(percent) <= CALIBRATION_MAX_PERCENT;
+    }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef CDSCLASSIFIER_H
+#define CDSCLASSIFIER_H
+
+#include <FEHIO.h>
+#include <math.h>
+
+#include "microClock.h"
+#include "scheduler.h"
+
+// Colours classify() can return.
+#define CDS_NONE -1
+#define CDS_BLUE 0
+#define CDS_RED 1
+// CdS voltages over the red and blue light (no filter, see CDS Sensor Test/main.cpp: red 0.599-0.750, blue
+// 1.040-1.156), and the ambient they were measured in. Scaled by the ambient actually measured, see setAmbient().
+#define CDS_RED_VOLTS 0.68
+#define CDS_BLUE_VOLTS 1.10
+#define CDS_REFERENCE_AMBIENT 2.9
+// Time between samples (us), and how many of the latest samples a reading is averaged over.
+#define CDS_SAMPLE_US 2000
+#define CDS_BURST 16
+// The burst is settled once it spans less than this many volts. classify() waits up to CDS_SETTLE_TIMEOUT seconds
+// for that, then goes with what it has (at a lower confidence).
+#define CDS_SETTLED_SPREAD 0.08
+#define CDS_SETTLE_TIMEOUT 0.5
+
+/**
+ * @brief One jukebox reading: the colour, how sure it is of it (0 to 1), the burst it came from, and how long
+ * classify() had to wait for it to settle.
+ */
+struct CdsReading
+{
+    int color;
+    float confidence;
+    // Average and max - min of the burst, in volts.
+    float volts, spread;
+    // Seconds spent in classify() waiting for the burst to settle.
+    float waited;
+};
+
+/**
+ * @brief Tells red from blue on the CdS cell from a burst of samples instead of a single read.
+ *
+ * start() begins sampling every CDS_SAMPLE_US in the background, so the cell is already being read while the robot
+ * drives up to the light. classify() then only has to wait until the last CDS_BURST samples agree with each other
+ * (the robot has stopped and the cell has caught up), which is usually by the time the drive ends.
+ *
+ * The red and blue levels were measured by hand in one room. Light lowers the cell's resistance and so the voltage
+ * (about 2.9 V dark, about 0.6 V under the red light), and a brighter room adds to whatever the cell sees, so every
+ * reading comes out lower, the lights' included. The levels are scaled by the ambient baseline over
+ * CDS_REFERENCE_AMBIENT, using the baseline the start light detector takes anyway: a brighter room reads under the
+ * reference and takes the levels down with it, a darker one takes them up. The burst average goes to whichever
+ * level is nearer. Anything nearer the ambient than to either light is CDS_NONE. Confidence is how much nearer it
+ * is to the winner than to the runner up, as a fraction of the gap between them, cut down by the spread of the
+ * burst.
+ *
+ * The following functions are included in the CdsClassifier class:
+ * void setAmbient(float volts) - what the cell reads with no light on it
+ * void start() - starts sampling in the background
+ * bool step() - takes a sample when due, called by the scheduler
+ * CdsReading classify() - waits for the burst to settle, stops sampling and classifies it
+ */
+class CdsClassifier : public Task
+{
+public:
+    float ambient;
+    // Samples taken since start().
+    int samples;
+
+    CdsClassifier(AnalogInputPin &pin, Scheduler &sched)
+    {
+        cds = &pin;
+        scheduler = &sched;
+        ambient = CDS_REFERENCE_AMBIENT;
+        samples = 0;
+        head = 0;
+        lastSample = 0;
+    }
+
+    void setAmbient(float volts)
+    {
+        if (volts > 0.0)
+        {
+            ambient = volts;
+        }
+    }
+
+    /**
+     * @brief Starts sampling. Call before driving up to the light.
+     */
+    void start()
+    {
+        samples = 0;
+        head = 0;
+        lastSample = MicrosNow() - CDS_SAMPLE_US;
+        scheduler->start(this);
+    }
+
+    bool step()
+    {
+        unsigned long now = MicrosNow();
+        if (now - lastSample >= CDS_SAMPLE_US)
+        {
+            lastSample = now;
+            burst[head] = cds->Value();
+            head = (head + 1) % CDS_BURST;
+            samples++;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Waits until the burst settles (or CDS_SETTLE_TIMEOUT), stops sampling and classifies the burst.
+     * Starts sampling first if start() wasn't called.
+     */
+    CdsReading classify()
+    {
+        if (!running)
+        {
+            start();
+        }
+        double waitStart = TimeNow();
+        float low, high, sum;
+        while (true)
+        {
+            int count = samples < CDS_BURST ? samples : CDS_BURST;
+            low = 100.0;
+            high = -100.0;
+            sum = 0.0;
+            for (int i = 0; i < count; i++)
+            {
+                low = fmin(low, burst[i]);
+                high = fmax(high, burst[i]);
+                sum += burst[i];
+            }
+            if ((count == CDS_BURST && high - low < CDS_SETTLED_SPREAD) ||
+                (count > 0 && TimeNow() - waitStart > CDS_SETTLE_TIMEOUT))
+            {
+                sum /= count;
+                break;
+            }
+            // Not on the scheduler if it had no room for it, so the samples get taken here instead.
+            if (!running)
+            {
+                step();
+            }
+            scheduler->tick();
+        }
+        scheduler->cancel(this);
+
+        CdsReading reading;
+        reading.volts = sum;
+        reading.spread = high - low;
+        reading.waited = TimeNow() - waitStart;
+        float scale = ambient / CDS_REFERENCE_AMBIENT;
+        float red = fabs(reading.volts - CDS_RED_VOLTS * scale);
+        float blue = fabs(reading.volts - CDS_BLUE_VOLTS * scale);
+        float none = fabs(reading.volts - ambient);
+        float gap = (CDS_BLUE_VOLTS - CDS_RED_VOLTS) * scale;
+        float nearest, second;
+        if (none < red && none < blue)
+        {
+            reading.color = CDS_NONE;
+            nearest = none;
+            second = fmin(red, blue);
+        }
+        else if (red < blue)
+        {
+            reading.color = CDS_RED;
+            nearest = red;
+            second = fmin(blue, none);
+        }
+        else
+        {
+            reading.color = CDS_BLUE;
+            nearest = blue;
+            second = fmin(red, none);
+        }
+        reading.confidence = (second - nearest) / gap - reading.spread / gap;
+        reading.confidence = fmax(0.0, fmin(1.0, reading.confidence));
+        return reading;
+    }
+
+private:
+    AnalogInputPin *cds;
+    Scheduler *scheduler;
+    // Last CDS_BURST samples, a ring with head the oldest.
+    float burst[CDS_BURST];
+    int head;
+    unsigned long lastSample;
+};
+
+#endif
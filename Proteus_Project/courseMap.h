@@ -0,0 +1,392 @@
+#ifndef COURSEMAP_H
+#define COURSEMAP_H
+
+#include <math.h>
+#include <stdlib.h>
+
+// Grid the course is mapped onto: 1 in cells over the 36 x 72 in course, a bit per cell.
+#define MAP_CELL 1.0
+#define MAP_COLUMNS 36
+#define MAP_ROWS 72
+#define MAP_CELLS (MAP_COLUMNS * MAP_ROWS)
+// Obstacles are grown by this much (inches), so a cell is free if the robot's center can be there without its sides
+// touching an obstacle: half the width across the wheels (the 8 in wheelspan the odometry uses). Routes are driven
+// along their legs, so it's the sides that pass things. The half diagonal of the chassis would be over 6 in, and that
+// shuts the 12 in gap between the ramp sides. There's no clearance on top: half an inch more already sends the
+// route to the jukebox buttons round the jukebox instead of straight in, and the red one gets missed. Any room for
+// bits that stick out past the wheels has to go in the obstacle outlines instead.
+#define MAP_ROBOT_WIDTH 8.0
+#define MAP_ROBOT_RADIUS (MAP_ROBOT_WIDTH / 2.0)
+// Cells searched around a blocked start or goal for a free one. Most task waypoints are right up against something.
+#define MAP_SNAP_CELLS 8
+// A* step costs, whole numbers so they fit a short: a cell straight across, and one diagonally (10 root 2).
+#define MAP_STEP_COST 10
+#define MAP_DIAGONAL_COST 14
+#define MAP_UNREACHED 0xFFFF
+
+/**
+ * @brief Rectangle on the course the robot can't drive into, in RPS inches.
+ */
+struct MapObstacle
+{
+    float x0, y0, x1, y1;
+};
+
+/**
+ * @brief Working space for one CourseMap::route() search, about 20 KB. Only needed while routes are being worked out,
+ * so it's allocated for that and freed again, see Mission::planRoutes().
+ */
+struct MapSearch
+{
+    // Cost from the start (MAP_STEP_COST a cell, MAP_UNREACHED if not reached), cell it was reached from, and the
+    // open cells as a binary heap on cost plus the estimate to the goal, with each cell's place in the heap (-1 if
+    // it isn't in it).
+    unsigned short cost[MAP_CELLS];
+    short parent[MAP_CELLS];
+    short heap[MAP_CELLS];
+    short heapPos[MAP_CELLS];
+    int heapSize;
+    int goal;
+};
+
+/**
+ * @brief Occupancy grid of the course and shortest collision free routes across it.
+ *
+ * build() marks every cell whose center is closer than the robot radius to an obstacle or to the course walls.
+ * route() runs A* over the free cells (8 way, no cutting past blocked corners), then pulls the path tight: from each
+ * corner it jumps to the farthest cell it can still see in a straight line, so what comes out is a handful of
+ * corners rather than a staircase of cells. A start or goal that's inside a grown obstacle (a button, the grill) is
+ * moved to the closest free cell for the search, and the goal itself is added back on the end, so the last leg runs
+ * straight in to it.
+ *
+ * A search is a few milliseconds on the Proteus, so routes get worked out before the start light, see
+ * Mission::planRoutes(). Only the grid itself (a bit a cell, 324 bytes) stays in memory, the search works in a
+ * MapSearch it's handed.
+ *
+ * The following functions are included in the CourseMap class:
+ * void build(const MapObstacle *obstacles, int count, float offsetX, float offsetY) - marks the blocked cells
+ * bool blocked(int column, int row) - whether a cell is blocked (anything off the course is)
+ * bool lineFree(float x0, float y0, float x1, float y1) - whether a straight line only crosses free cells
+ * int route(MapSearch &search, float fromX, float fromY, float toX, float toY, float *xs, float *ys, int max) - shortest
+ *      route
+ */
+class CourseMap
+{
+public:
+    // Cells the last route() expanded, and how long the route it found is (inches, from the start point).
+    long expanded;
+    float length;
+
+    CourseMap()
+    {
+        for (int i = 0; i < (MAP_CELLS + 7) / 8; i++)
+        {
+            cells[i] = 0;
+        }
+        expanded = 0;
+        length = 0.0;
+    }
+
+    /**
+     * @brief Marks the cells the robot's center can't be in.
+     *
+     * @param offsetX, offsetY Shift for the region, the obstacles are measured in the same place as the waypoints
+     */
+    void build(const MapObstacle *obstacles, int count, float offsetX, float offsetY)
+    {
+        for (int row = 0; row < MAP_ROWS; row++)
+        {
+            for (int column = 0; column < MAP_COLUMNS; column++)
+            {
+                float x = (column + 0.5) * MAP_CELL, y = (row + 0.5) * MAP_CELL;
+                // Course walls
+                bool hit = x < MAP_ROBOT_RADIUS || y < MAP_ROBOT_RADIUS || x > MAP_COLUMNS * MAP_CELL - MAP_ROBOT_RADIUS ||
+                           y > MAP_ROWS * MAP_CELL - MAP_ROBOT_RADIUS;
+                for (int i = 0; i < count && !hit; i++)
+                {
+                    float dx = fmax(fmax(obstacles[i].x0 + offsetX - x, x - obstacles[i].x1 - offsetX), 0.0);
+                    float dy = fmax(fmax(obstacles[i].y0 + offsetY - y, y - obstacles[i].y1 - offsetY), 0.0);
+                    hit = dx * dx + dy * dy < MAP_ROBOT_RADIUS * MAP_ROBOT_RADIUS;
+                }
+                int cell = row * MAP_COLUMNS + column;
+                if (hit)
+                {
+                    cells[cell / 8] |= 1 << (cell % 8);
+                }
+                else
+                {
+                    cells[cell / 8] &= ~(1 << (cell % 8));
+                }
+            }
+        }
+    }
+
+    bool blocked(int column, int row)
+    {
+        if (column < 0 || row < 0 || column >= MAP_COLUMNS || row >= MAP_ROWS)
+        {
+            return true;
+        }
+        int cell = row * MAP_COLUMNS + column;
+        return cells[cell / 8] & (1 << (cell % 8));
+    }
+
+    bool lineFree(float x0, float y0, float x1, float y1)
+    {
+        // Quarter cell steps, fine enough not to skip the corner of a cell.
+        int steps = (int)ceil(hypot(x1 - x0, y1 - y0) / (MAP_CELL / 4.0));
+        for (int i = 0; i <= steps; i++)
+        {
+            float t = steps > 0 ? (float)i / steps : 0.0;
+            if (blocked(columnOf(x0 + (x1 - x0) * t), rowOf(y0 + (y1 - y0) * t)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Shortest collision free route between two points.
+     *
+     * @param search Working space for the search, anything in it is overwritten
+     * @param xs, ys Filled with the corners of the route and then the goal, not including the start
+     * @param max Most points that fit in xs and ys
+     * @return Points written, 0 if there's no route or it has more than max corners
+     */
+    int route(MapSearch &search, float fromX, float fromY, float toX, float toY, float *xs, float *ys, int max)
+    {
+        expanded = 0;
+        length = 0.0;
+        int start = snap(columnOf(fromX), rowOf(fromY));
+        int goal = snap(columnOf(toX), rowOf(toY));
+        if (start < 0 || goal < 0 || max < 1)
+        {
+            return 0;
+        }
+        for (int i = 0; i < MAP_CELLS; i++)
+        {
+            search.cost[i] = MAP_UNREACHED;
+            search.parent[i] = -1;
+            search.heapPos[i] = -1;
+        }
+        search.heapSize = 0;
+        search.goal = goal;
+        search.cost[start] = 0;
+        push(search, start);
+        while (search.heapSize > 0)
+        {
+            int cell = pop(search);
+            if (cell == goal)
+            {
+                break;
+            }
+            expanded++;
+            int column = cell % MAP_COLUMNS, row = cell / MAP_COLUMNS;
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    if ((dx == 0 && dy == 0) || blocked(column + dx, row + dy))
+                    {
+                        continue;
+                    }
+                    // Diagonal moves only between free cells, or the route clips the corner in between.
+                    if (dx != 0 && dy != 0 && (blocked(column + dx, row) || blocked(column, row + dy)))
+                    {
+                        continue;
+                    }
+                    int next = cell + dy * MAP_COLUMNS + dx;
+                    int g = search.cost[cell] + (dx != 0 && dy != 0 ? MAP_DIAGONAL_COST : MAP_STEP_COST);
+                    if (g < search.cost[next])
+                    {
+                        search.cost[next] = g;
+                        search.parent[next] = cell;
+                        push(search, next);
+                    }
+                }
+            }
+        }
+        if (start != goal && search.parent[goal] < 0)
+        {
+            return 0;
+        }
+
+        // Cells from the start to the goal. The heap's done with, so it holds them.
+        short *heap = search.heap;
+        int count = 0;
+        for (int cell = goal; cell >= 0; cell = search.parent[cell])
+        {
+            heap[count++] = cell;
+        }
+        for (int i = 0; i < count / 2; i++)
+        {
+            short swap = heap[i];
+            heap[i] = heap[count - 1 - i];
+            heap[count - 1 - i] = swap;
+        }
+
+        int written = 0;
+        for (int anchor = 0; anchor < count - 1;)
+        {
+            int next = count - 1;
+            while (next > anchor + 1 && !lineFree(centerX(heap[anchor]), centerY(heap[anchor]), centerX(heap[next]),
+                                                 centerY(heap[next])))
+            {
+                next--;
+            }
+            if (written >= max)
+            {
+                return 0;
+            }
+            xs[written] = centerX(heap[next]);
+            ys[written] = centerY(heap[next]);
+            written++;
+            anchor = next;
+        }
+        // The goal itself, in place of the center of its cell, or after the free cell next to it.
+        if (written > 0 && goal == rowOf(toY) * MAP_COLUMNS + columnOf(toX))
+        {
+            written--;
+        }
+        if (written >= max)
+        {
+            return 0;
+        }
+        xs[written] = toX;
+        ys[written] = toY;
+        written++;
+
+        float x = fromX, y = fromY;
+        for (int i = 0; i < written; i++)
+        {
+            length += hypot(xs[i] - x, ys[i] - y);
+            x = xs[i];
+            y = ys[i];
+        }
+        return written;
+    }
+
+private:
+    // Bit per cell, set if blocked.
+    unsigned char cells[(MAP_CELLS + 7) / 8];
+
+    int columnOf(float x)
+    {
+        int column = (int)floor(x / MAP_CELL);
+        return column < 0 ? 0 : (column >= MAP_COLUMNS ? MAP_COLUMNS - 1 : column);
+    }
+
+    int rowOf(float y)
+    {
+        int row = (int)floor(y / MAP_CELL);
+        return row < 0 ? 0 : (row >= MAP_ROWS ? MAP_ROWS - 1 : row);
+    }
+
+    float centerX(int cell)
+    {
+        return (cell % MAP_COLUMNS + 0.5) * MAP_CELL;
+    }
+
+    float centerY(int cell)
+    {
+        return (cell / MAP_COLUMNS + 0.5) * MAP_CELL;
+    }
+
+    /**
+     * @brief The cell, or if it's blocked the closest free cell within MAP_SNAP_CELLS. -1 if there's none.
+     */
+    int snap(int column, int row)
+    {
+        int best = -1;
+        float bestDistance = 1e9;
+        for (int ring = 0; ring <= MAP_SNAP_CELLS && best < 0; ring++)
+        {
+            for (int dy = -ring; dy <= ring; dy++)
+            {
+                for (int dx = -ring; dx <= ring; dx++)
+                {
+                    if ((abs(dx) != ring && abs(dy) != ring) || blocked(column + dx, row + dy))
+                    {
+                        continue;
+                    }
+                    float distance = dx * dx + dy * dy;
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = (row + dy) * MAP_COLUMNS + column + dx;
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+    // Octile distance to the goal in step costs, never more than the real cost.
+    int estimate(const MapSearch &search, int cell)
+    {
+        int dx = abs(cell % MAP_COLUMNS - search.goal % MAP_COLUMNS);
+        int dy = abs(cell / MAP_COLUMNS - search.goal / MAP_COLUMNS);
+        return MAP_STEP_COST * (dx + dy) + (MAP_DIAGONAL_COST - 2 * MAP_STEP_COST) * (dx < dy ? dx : dy);
+    }
+
+    bool before(const MapSearch &search, int a, int b)
+    {
+        return search.cost[a] + estimate(search, a) < search.cost[b] + estimate(search, b);
+    }
+
+    void place(MapSearch &search, int cell, int i)
+    {
+        search.heap[i] = cell;
+        search.heapPos[cell] = i;
+    }
+
+    // Adds a cell, or moves it up if it's already in and just got cheaper.
+    void push(MapSearch &search, int cell)
+    {
+        int i = search.heapPos[cell];
+        if (i < 0)
+        {
+            i = search.heapSize++;
+        }
+        while (i > 0 && before(search, cell, search.heap[(i - 1) / 2]))
+        {
+            place(search, search.heap[(i - 1) / 2], i);
+            i = (i - 1) / 2;
+        }
+        place(search, cell, i);
+    }
+
+    int pop(MapSearch &search)
+    {
+        int top = search.heap[0];
+        search.heapPos[top] = -1;
+        int last = search.heap[--search.heapSize];
+        int i = 0;
+        while (search.heapSize > 0)
+        {
+            int child = 2 * i + 1;
+            if (child >= search.heapSize)
+            {
+                break;
+            }
+            if (child + 1 < search.heapSize && before(search, search.heap[child + 1], search.heap[child]))
+            {
+                child++;
+            }
+            if (!before(search, search.heap[child], last))
+            {
+                break;
+            }
+            place(search, search.heap[child], i);
+            i = child;
+        }
+        if (search.heapSize > 0)
+        {
+            place(search, last, i);
+        }
+        return top;
+    }
+};
+
+#endif
@@ -0,0 +1,328 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <FEHLCD.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logRecords.h"
+#include "microClock.h"
+#include "runLog.h"
+#include "scheduler.h"
+
+// Most widgets across all pages.
+#define MAX_WIDGETS 16
+// Characters in a text widget, a full row of the LCD.
+#define DISPLAY_TEXT_LENGTH 27
+// LCD size and the height of one row of text (pixels).
+#define DISPLAY_WIDTH 320
+#define DISPLAY_ROW_HEIGHT 17
+#define DISPLAY_BACKGROUND BLACK
+// Time between frames (us), and how long a frame keeps drawing before it leaves the rest for the next one.
+#define DISPLAY_PERIOD_US 100000
+#define DISPLAY_FRAME_BUDGET_US 5000
+// Page for widgets that show on every page (status lines).
+#define DISPLAY_ALL_PAGES -1
+
+// Widget kinds.
+#define WIDGET_TEXT 0
+#define WIDGET_BOX 1
+#define WIDGET_CIRCLE 2
+
+/**
+ * @brief One thing on the screen: a row of text, a filled box or a filled circle. Only redrawn when it changes.
+ */
+struct Widget
+{
+    int kind, page;
+    // Text: top left of the row. Box: top left and size. Circle: center and radius in w.
+    int x, y, w, h;
+    unsigned int color;
+    char text[DISPLAY_TEXT_LENGTH];
+    // Changed since it was last drawn.
+    bool dirty;
+};
+
+/**
+ * @brief Draws the LCD in the background, a changed widget at a time, so the screen never stalls a control loop.
+ *
+ * Code that wants something on the screen sets a widget (setText(), setColor()) and carries on. That only marks
+ * the widget dirty if it actually changed. The display is a task on the scheduler and draws at most one frame
+ * every DISPLAY_PERIOD_US, and never while a control loop is running: even one text row costs a few ms on the
+ * LCD, most of a control period. A frame draws dirty widgets until it has used DISPLAY_FRAME_BUDGET_US and leaves
+ * the rest for the next one, so starting the next motion is never held up by more than that either.
+ *
+ * Widgets belong to a page, and only the shown page is drawn. Changing page clears the screen and redraws
+ * that page's widgets. Widgets on DISPLAY_ALL_PAGES are drawn on every page. Anything that writes to the LCD
+ * directly (menus before the run) should call invalidate() afterwards, so the whole page is drawn again.
+ *
+ * Every frame is timed. The totals go in the run log as LOG_DISPLAY with log().
+ *
+ * The following functions are included in the Display class:
+ * void start() - starts drawing in the background
+ * int addText(int page, int row, unsigned int color) - adds a row of text, returns its id
+ * int addBox(int page, int x, int y, int width, int height) - adds a filled box, returns its id
+ * int addCircle(int page, int x, int y, int radius) - adds a filled circle, returns its id
+ * void setText(int id, const char *text) - changes a text widget
+ * void setColor(int id, unsigned int color) - changes a widget's colour
+ * void showPage(int page) - switches page
+ * void invalidate() - the screen was drawn over, draw the whole page again
+ * bool step() - draws a frame if one is due, called by the scheduler
+ * void flush() - draws everything that's dirty right now
+ * void log() - logs the frame stats as a LOG_DISPLAY record
+ */
+class Display : public Task
+{
+public:
+    Widget widgets[MAX_WIDGETS];
+    int numWidgets;
+    // Page asked for, page actually on the screen (-2 if unknown).
+    int page, shownPage;
+    // Frames drawn, frames put off because a control loop was running, widgets drawn.
+    unsigned long frames, deferredFrames, widgetsDrawn;
+    // Time spent drawing: all frames, the last frame, the longest frame (us).
+    unsigned long drawMicros, lastFrameMicros, worstFrameMicros;
+
+    Display(Scheduler &sched, RunLog &log)
+    {
+        scheduler = &sched;
+        runLog = &log;
+        numWidgets = 0;
+        page = 0;
+        shownPage = -2;
+        frames = 0;
+        deferredFrames = 0;
+        widgetsDrawn = 0;
+        drawMicros = 0;
+        lastFrameMicros = 0;
+        worstFrameMicros = 0;
+        frameStart = 0;
+    }
+
+    /**
+     * @brief Starts drawing in the background. The first frame is due right away.
+     */
+    void start()
+    {
+        frameStart = MicrosNow() - DISPLAY_PERIOD_US;
+        scheduler->start(this);
+    }
+
+    int addText(int widgetPage, int row, unsigned int color = WHITE)
+    {
+        int id = add(WIDGET_TEXT, widgetPage, 0, row * DISPLAY_ROW_HEIGHT, DISPLAY_WIDTH, DISPLAY_ROW_HEIGHT);
+        if (id >= 0)
+        {
+            widgets[id].color = color;
+        }
+        return id;
+    }
+
+    int addBox(int widgetPage, int x, int y, int width, int height)
+    {
+        return add(WIDGET_BOX, widgetPage, x, y, width, height);
+    }
+
+    int addCircle(int widgetPage, int x, int y, int radius)
+    {
+        return add(WIDGET_CIRCLE, widgetPage, x, y, radius, radius);
+    }
+
+    /**
+     * @brief Changes what a text widget says. Cut to the width of the screen.
+     */
+    void setText(int id, const char *text)
+    {
+        if (id < 0 || strncmp(widgets[id].text, text, DISPLAY_TEXT_LENGTH - 1) == 0)
+        {
+            return;
+        }
+        int length = 0;
+        while (length < DISPLAY_TEXT_LENGTH - 1 && text[length] != '\0')
+        {
+            widgets[id].text[length] = text[length];
+            length++;
+        }
+        widgets[id].text[length] = '\0';
+        widgets[id].dirty = true;
+    }
+
+    void setColor(int id, unsigned int color)
+    {
+        if (id < 0 || widgets[id].color == color)
+        {
+            return;
+        }
+        widgets[id].color = color;
+        widgets[id].dirty = true;
+    }
+
+    /**
+     * @brief Switches to another page. The clear and redraw happen in the following frames.
+     */
+    void showPage(int newPage)
+    {
+        page = newPage;
+    }
+
+    /**
+     * @brief Something else drew on the LCD, so the next frame clears it and draws the whole page.
+     */
+    void invalidate()
+    {
+        shownPage = -2;
+    }
+
+    /**
+     * @brief Draws a frame if one is due. Never finishes.
+     */
+    bool step()
+    {
+        unsigned long now = MicrosNow();
+        if (now - frameStart < DISPLAY_PERIOD_US)
+        {
+            return false;
+        }
+        frameStart = now;
+        if (!scheduler->idle())
+        {
+            deferredFrames++;
+            return false;
+        }
+        bool drawn = false;
+        if (page != shownPage)
+        {
+            clearPage();
+            drawn = true;
+        }
+        while (MicrosNow() - now < DISPLAY_FRAME_BUDGET_US && drawNext())
+        {
+            drawn = true;
+        }
+        if (drawn)
+        {
+            endFrame(now);
+        }
+        return false;
+    }
+
+    /**
+     * @brief Draws everything dirty now, whatever is running. For before and after the run.
+     */
+    void flush()
+    {
+        unsigned long now = MicrosNow();
+        if (page != shownPage)
+        {
+            clearPage();
+        }
+        while (drawNext())
+        {
+        }
+        endFrame(now);
+    }
+
+    void log()
+    {
+        runLog->add(LOG_DISPLAY, 0, frames, deferredFrames, widgetsDrawn, drawMicros, worstFrameMicros);
+    }
+
+private:
+    Scheduler *scheduler;
+    RunLog *runLog;
+    // MicrosNow() when the last frame started.
+    unsigned long frameStart;
+
+    int add(int kind, int widgetPage, int x, int y, int w, int h)
+    {
+        if (numWidgets >= MAX_WIDGETS)
+        {
+            return -1;
+        }
+        Widget &widget = widgets[numWidgets];
+        widget.kind = kind;
+        widget.page = widgetPage;
+        widget.x = x;
+        widget.y = y;
+        widget.w = w;
+        widget.h = h;
+        widget.color = DISPLAY_BACKGROUND;
+        widget.text[0] = '\0';
+        widget.dirty = false;
+        return numWidgets++;
+    }
+
+    bool onPage(Widget &widget)
+    {
+        return widget.page == page || widget.page == DISPLAY_ALL_PAGES;
+    }
+
+    /**
+     * @brief Clears the screen for the current page and marks everything on it dirty.
+     */
+    void clearPage()
+    {
+        LCD.SetBackgroundColor(DISPLAY_BACKGROUND);
+        LCD.Clear();
+        for (int i = 0; i < numWidgets; i++)
+        {
+            if (onPage(widgets[i]))
+            {
+                widgets[i].dirty = true;
+            }
+        }
+        shownPage = page;
+    }
+
+    /**
+     * @brief Draws the first dirty widget on the page.
+     *
+     * @return false if there was nothing to draw
+     */
+    bool drawNext()
+    {
+        for (int i = 0; i < numWidgets; i++)
+        {
+            Widget &widget = widgets[i];
+            if (!widget.dirty || !onPage(widget))
+            {
+                continue;
+            }
+            if (widget.kind == WIDGET_TEXT)
+            {
+                // Blank the row first, a shorter string wouldn't cover the old one.
+                LCD.SetFontColor(DISPLAY_BACKGROUND);
+                LCD.FillRectangle(widget.x, widget.y, widget.w, widget.h);
+                LCD.SetFontColor(widget.color);
+                LCD.WriteAt(widget.text, widget.x, widget.y);
+            }
+            else if (widget.kind == WIDGET_BOX)
+            {
+                LCD.SetFontColor(widget.color);
+                LCD.FillRectangle(widget.x, widget.y, widget.w, widget.h);
+            }
+            else
+            {
+                LCD.SetFontColor(widget.color);
+                LCD.FillCircle(widget.x, widget.y, widget.w);
+            }
+            widget.dirty = false;
+            widgetsDrawn++;
+            return true;
+        }
+        return false;
+    }
+
+    void endFrame(unsigned long start)
+    {
+        lastFrameMicros = MicrosNow() - start;
+        drawMicros += lastFrameMicros;
+        if (lastFrameMicros > worstFrameMicros)
+        {
+            worstFrameMicros = lastFrameMicros;
+        }
+        frames++;
+    }
+};
+
+#endif
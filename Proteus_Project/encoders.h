@@ -0,0 +1,162 @@
+#ifndef ENCODERS_H
+#define ENCODERS_H
+
+#include <FEHIO.h>
+#include <FEHUtility.h>
+
+#include "microClock.h"
+
+/**
+ * @brief Edge driven shaft encoder for one pinwheel.
+ *
+ * The firmware's DigitalEncoder counts every black/white transition from a port interrupt, so ticks keep
+ * accumulating no matter what the control loop is busy with (RPS reads, SetPercent, LCD writes...).
+ * Update() folds the new interrupt counts into this object, timestamps them and throws away glitches.
+ *
+ * Glitch rejection: the pinwheel physically can't produce more than maxTickRate transitions per second, and
+ * can't speed up by more than half from one tick to the next. If more counts than that show up between two
+ * Update() calls, the extra ones are electrical noise (bouncing on a black/white border) and are dropped.
+ * The count of dropped ticks is kept for debugging.
+ *
+ * The following functions are included in the Encoder class:
+ * void Update() - reads new ticks from the interrupt counter, timestamps them and rejects glitches
+ * int Counts() - accepted ticks since the last ResetCounts() (totalCounts is never reset)
+ * void ResetCounts() - zeroes the tick count
+ * float TickRate() - ticks per second measured from the tick timestamps
+ */
+class Encoder
+{
+public:
+    // Ticks accepted since ResetCounts(), ticks thrown away as glitches.
+    int counts, rejected;
+    // Ticks accepted since power on. Never reset, for anything that tracks the wheel across motions (odometry).
+    int totalCounts;
+    // Microsecond timestamps of the most recent accepted tick and of the most recent Update().
+    unsigned long lastTickMicros, lastUpdateMicros;
+    // Smoothed microseconds per tick. 0 until two ticks have been seen.
+    unsigned long tickPeriodMicros;
+    // Fastest believable tick rate in ticks per second.
+    float maxTickRate;
+
+    /**
+     * @brief Construct a new Encoder object
+     *
+     * @param pin The digital pin the optosensor is wired to.
+     * @param maxRate Optional. Fastest believable tick rate in ticks/s. Anything faster is treated as a glitch.
+     */
+    Encoder(FEHIO::FEHIOPin pin, float maxRate = 1000.0) : edges(pin, FEHIO::EitherEdge)
+    {
+        maxTickRate = maxRate;
+        rawCounts = 0;
+        counts = 0;
+        totalCounts = 0;
+        rejected = 0;
+        lastTickMicros = 0;
+        lastUpdateMicros = 0;
+        tickPeriodMicros = 0;
+    }
+
+    /**
+     * @brief Reads the ticks counted by the interrupt since the last call, rejects any that come in faster than the
+     * pinwheel can turn and timestamps the rest.
+     */
+    void Update()
+    {
+        unsigned long now = MicrosNow();
+        int raw = edges.Counts();
+        int newTicks = raw - rawCounts;
+        rawCounts = raw;
+        if (newTicks <= 0)
+        {
+            lastUpdateMicros = now;
+            return;
+        }
+        // No more ticks than the wheel could have made since the last one at its top speed. This is what
+        // throws out a bounce that shows up on its own a few microseconds after a real tick.
+        unsigned long sinceLastTick = now - lastTickMicros;
+        int allowed = (int)(sinceLastTick * maxTickRate / 1000000.0);
+        // Once the wheel is turning, it can't speed up by more than half between two ticks either. This is what
+        // throws out a bounce that gets counted together with real ticks after a long loop iteration.
+        if (tickPeriodMicros != 0)
+        {
+            int expected = (int)(1.5 * sinceLastTick / tickPeriodMicros);
+            if (expected < 1)
+            {
+                expected = 1;
+            }
+            if (expected < allowed)
+            {
+                allowed = expected;
+            }
+        }
+        if (newTicks > allowed)
+        {
+            rejected += newTicks - allowed;
+            newTicks = allowed;
+        }
+        if (newTicks == 0)
+        {
+            lastUpdateMicros = now;
+            return;
+        }
+        // Period is only measured tick to tick, the time from ResetCounts() to the first tick says nothing.
+        // Smooth it a little, ticks are only timestamped when Update() gets to look at them.
+        if (counts > 0)
+        {
+            unsigned long period = sinceLastTick / newTicks;
+            if (tickPeriodMicros == 0)
+            {
+                tickPeriodMicros = period;
+            }
+            else
+            {
+                tickPeriodMicros = (3 * tickPeriodMicros + period) / 4;
+            }
+        }
+        counts += newTicks;
+        totalCounts += newTicks;
+        lastTickMicros = now;
+        lastUpdateMicros = now;
+    }
+
+    /**
+     * @brief Accepted ticks since the last ResetCounts()
+     */
+    int Counts()
+    {
+        return counts;
+    }
+
+    /**
+     * @brief Zeroes the tick count. Timing history is thrown away too, since it belongs to the previous motion.
+     */
+    void ResetCounts()
+    {
+        edges.ResetCounts();
+        rawCounts = 0;
+        counts = 0;
+        rejected = 0;
+        tickPeriodMicros = 0;
+        lastUpdateMicros = MicrosNow();
+        lastTickMicros = lastUpdateMicros;
+    }
+
+    /**
+     * @brief Smoothed ticks per second. Drops to 0 if the wheel hasn't ticked for a while.
+     */
+    float TickRate()
+    {
+        if (tickPeriodMicros == 0 || MicrosNow() - lastTickMicros > 4 * tickPeriodMicros + 100000)
+        {
+            return 0.0;
+        }
+        return 1000000.0 / tickPeriodMicros;
+    }
+
+private:
+    DigitalEncoder edges;
+    // Interrupt count at the last Update()
+    int rawCounts;
+};
+
+#endif
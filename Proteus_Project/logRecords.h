@@ -0,0 +1,153 @@
+#ifndef LOGRECORDS_H
+#define LOGRECORDS_H
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+    Run log record format. Shared by the robot (runLog.h) and the host decoder (Simulation/logDecode.cpp),
+    so nothing in here may depend on the FEH libraries.
+*/
+
+// Record types. Add new ones at the end so old logs still decode.
+#define LOG_RUN_START 0     // v0 = course number
+#define LOG_FLAVOR 1        // arg = ice cream flavor
+#define LOG_TRAVEL_TO 2     // arg = driveThere, v0, v1 = destination
+#define LOG_FOLLOW_PATH 3   // arg = number of points, v0, v1 = last point
+#define LOG_START_POSE 4    // v0, v1, v2 = x, y, heading the motion starts from
+#define LOG_TURN 5          // arg = path point turned toward, v0, v1 = relative destination, v2 = degrees to turn (positive is left)
+#define LOG_ARRIVED 6       // v0, v1, v2 = x, y, heading the motion ended at
+#define LOG_NO_RPS 7        // arg = LOG_TRAVEL_TO or LOG_FOLLOW_PATH that was skipped
+#define LOG_JUKEBOX 8       // arg = colour read (-1 none), v0 = CdS voltage, v1 = confidence, v2 = spread, v3 = s waited
+#define LOG_LOOP_TIMING 9   // arg = primitive, v0 = ticks, v1 = mean period, v2 = worst jitter, v3 = worst iteration (us), v4 = overruns
+#define LOG_RUN_END 10      // v0 = run time in seconds
+#define LOG_RPS_STATS 11    // v0 = frames, v1 = update rate, v2 = torn reads, v3 = dropouts
+#define LOG_DROPPED 12      // arg = records dropped because the buffer was full
+#define LOG_CALIBRATION 13  // arg = 0, 1 low/high speed: v0, v1 = left/right percent, v2, v3 = tick rates. arg = 2: v0, v1 = new equilibrium, v2 = 1 if kept
+#define LOG_BATTERY 14      // v0 = filtered voltage, v1 = last raw reading, v2 = motor command scale
+#define LOG_DISPLAY 15      // v0 = frames, v1 = frames put off while driving, v2 = widgets drawn, v3 = us drawing, v4 = worst frame (us)
+#define LOG_START_LIGHT 16  // arg = glitches, v0 = ambient (0 if already lit), v1 = lit voltage, v2 = us to detect, v3 = us to first motor command, v4 = readings
+#define LOG_MISSION 17       // arg = step, v0 = task, v1 = op, v2 = 1 worked 0 failed -1 skipped, v3 = tries, v4 = seconds
+#define LOG_PLAN 18          // arg = place in the plan: v0 = task, v1 = estimated s to finish it. arg = -1: v0 = tasks, v1 = expected points, v2 = estimated s, v3 = plans looked at
+#define LOG_ROUTE 19         // arg = step, v0 = route points (0 no route), v1 = route length in, v2 = cells searched
+#define LOG_SCHEDULER_FULL 20 // arg = primitive that couldn't be started. arg = -1 at run end: v0 = tasks start() had no room for
+#define LOG_TELEMETRY_STATS 21 // v0 = segments, v1 = samples, v2 = samples dropped because the buffer was full
+#define NUM_LOG_TYPES 22
+
+// Primitives for LOG_LOOP_TIMING and telemetry segments. The Motion modes come first so a mode can be logged as is.
+#define LOG_PRIMITIVE_FOLLOW 4
+#define NUM_LOG_PRIMITIVES 5
+
+// Values per record.
+#define LOG_VALUES 5
+// Characters per record line on the card, not counting the newline: 8 hex digits each for the time and each
+// value, 4 each for the type and arg.
+#define LOG_LINE_LENGTH (8 + 4 + 4 + 8 * LOG_VALUES)
+
+/**
+ * @brief One fixed size log record.
+ */
+struct LogRecord
+{
+    // MicrosNow() when it was logged.
+    unsigned long micros;
+    unsigned short type;
+    short arg;
+    float v[LOG_VALUES];
+};
+
+/**
+ * @brief Name of a record type, for the decoder.
+ */
+inline const char *logTypeName(int type)
+{
+    static const char *names[NUM_LOG_TYPES] = {"run_start", "flavor", "travel_to", "follow_path", "start_pose", "turn",
+                                               "arrived", "no_rps", "jukebox", "loop_timing", "run_end", "rps_stats",
+                                               "dropped", "calibration", "battery", "display", "start_light",
+                                               "mission", "plan", "route", "scheduler_full",
+                                               "telemetry_stats"};
+    return type >= 0 && type < NUM_LOG_TYPES ? names[type] : "unknown";
+}
+
+/**
+ * @brief Name of a primitive, for the decoders.
+ */
+inline const char *logPrimitiveName(int primitive)
+{
+    static const char *names[NUM_LOG_PRIMITIVES] = {"driveForward", "driveBackwards", "turn", "followPath", "follow"};
+    return primitive >= 0 && primitive < NUM_LOG_PRIMITIVES ? names[primitive] : "unknown";
+}
+
+/**
+ * @brief Bit pattern of a float as an integer, so it can be written out without losing anything.
+ */
+inline unsigned long floatBits(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bitsFloat(unsigned long bits)
+{
+    unsigned int word = (unsigned int)bits;
+    float value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Packs a record into a fixed width line of hex digits.
+ *
+ * @param record Record to pack
+ * @param line At least LOG_LINE_LENGTH + 1 chars
+ */
+inline void packRecord(const LogRecord &record, char *line)
+{
+    sprintf(line, "%08lx%04x%04x", record.micros & 0xffffffffUL, record.type, (unsigned short)record.arg);
+    for (int i = 0; i < LOG_VALUES; i++)
+    {
+        sprintf(line + 16 + 8 * i, "%08lx", floatBits(record.v[i]));
+    }
+}
+
+/**
+ * @brief Unpacks a line written by packRecord().
+ *
+ * @return false if the line isn't a whole record
+ */
+inline bool unpackRecord(const char *line, LogRecord &record)
+{
+    if (strlen(line) < LOG_LINE_LENGTH)
+    {
+        return false;
+    }
+    char field[9];
+    unsigned long value;
+    field[8] = '\0';
+    memcpy(field, line, 8);
+    if (sscanf(field, "%lx", &record.micros) != 1)
+    {
+        return false;
+    }
+    field[4] = '\0';
+    memcpy(field, line + 8, 4);
+    sscanf(field, "%lx", &value);
+    record.type = (unsigned short)value;
+    memcpy(field, line + 12, 4);
+    sscanf(field, "%lx", &value);
+    record.arg = (short)(unsigned short)value;
+    field[8] = '\0';
+    for (int i = 0; i < LOG_VALUES; i++)
+    {
+        memcpy(field, line + 16 + 8 * i, 8);
+        if (sscanf(field, "%lx", &value) != 1)
+        {
+            return false;
+        }
+        record.v[i] = bitsFloat(value);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef LOOPTIMER_H
+#define LOOPTIMER_H
+
+#include <FEHUtility.h>
+#include <stdio.h>
+
+#include "microClock.h"
+#include "runLog.h"
+
+// Default control period in microseconds (200 Hz)
+#define CONTROL_PERIOD_US 5000
+
+/**
+ * @brief Fixed rate tick for a control loop, with timing stats.
+ *
+ * A control loop calls due() every time it gets the chance. due() returns true once per period, and the loop
+ * does its work and then calls done(). If the loop was starved for more than a whole period (a long LCD write,
+ * another task hogging the scheduler) the missed ticks are counted as an overrun instead of being run back to back.
+ *
+ * The following functions are included in the LoopTimer class:
+ * void start(unsigned long period) - starts ticking and clears the stats
+ * bool due() - true if it's time for the next tick
+ * void done() - marks the end of the work for this tick
+ * void summary(char *line) - writes a compact one line summary (fits the LCD, put it on a Display row)
+ * void log(RunLog &runLog, int primitive) - logs the stats as a LOG_LOOP_TIMING record
+ */
+class LoopTimer
+{
+public:
+    // Nominal period, time the next tick is due, time the current tick started.
+    unsigned long periodMicros, nextTickMicros, tickStartMicros, lastTickMicros;
+    // Ticks run, ticks that had to be skipped or ran over their period.
+    unsigned long ticks, overruns;
+    // Sum of periods between ticks (for the mean), largest distance from the nominal period, longest tick.
+    unsigned long periodSum, worstJitter, worstIteration;
+
+    LoopTimer()
+    {
+        start(CONTROL_PERIOD_US);
+    }
+
+    /**
+     * @brief Starts ticking. The first tick is due right away.
+     *
+     * @param period Optional. Tick period in microseconds.
+     */
+    void start(unsigned long period = CONTROL_PERIOD_US)
+    {
+        periodMicros = period;
+        nextTickMicros = MicrosNow();
+        tickStartMicros = nextTickMicros;
+        lastTickMicros = 0;
+        ticks = 0;
+        overruns = 0;
+        periodSum = 0;
+        worstJitter = 0;
+        worstIteration = 0;
+    }
+
+    /**
+     * @brief Checks whether the next tick is due. Call as often as possible.
+     *
+     * @return true if the control loop should run now
+     */
+    bool due()
+    {
+        unsigned long now = MicrosNow();
+        if ((long)(now - nextTickMicros) < 0)
+        {
+            return false;
+        }
+        if (lastTickMicros != 0)
+        {
+            unsigned long period = now - lastTickMicros;
+            unsigned long jitter = period > periodMicros ? period - periodMicros : periodMicros - period;
+            periodSum += period;
+            if (jitter > worstJitter)
+            {
+                worstJitter = jitter;
+            }
+        }
+        // A whole tick went by without us. Don't try to catch up, just count it and start over from now.
+        if (now - nextTickMicros >= periodMicros)
+        {
+            overruns++;
+            nextTickMicros = now + periodMicros;
+        }
+        else
+        {
+            nextTickMicros += periodMicros;
+        }
+        lastTickMicros = now;
+        tickStartMicros = now;
+        ticks++;
+        return true;
+    }
+
+    /**
+     * @brief Marks the end of this tick's work. A tick that takes longer than the period counts as an overrun.
+     */
+    void done()
+    {
+        unsigned long iteration = MicrosNow() - tickStartMicros;
+        if (iteration > worstIteration)
+        {
+            worstIteration = iteration;
+        }
+        if (iteration > periodMicros)
+        {
+            overruns++;
+        }
+    }
+
+    /**
+     * @brief Mean period between ticks in microseconds
+     */
+    unsigned long meanPeriod()
+    {
+        return ticks > 1 ? periodSum / (ticks - 1) : 0;
+    }
+
+    /**
+     * @brief Compact summary: mean period, worst jitter, worst iteration time (all us) and overrun count.
+     *
+     * @param line At least 32 chars
+     */
+    void summary(char *line)
+    {
+        sprintf(line, "T%lu J%lu W%lu O%lu", meanPeriod(), worstJitter, worstIteration, overruns);
+    }
+
+    /**
+     * @brief Logs the stats to the run log, labelled with the primitive (a Motion mode or LOG_PRIMITIVE_FOLLOW).
+     */
+    void log(RunLog &runLog, int primitive)
+    {
+        runLog.add(LOG_LOOP_TIMING, primitive, ticks, meanPeriod(), worstJitter, worstIteration, overruns);
+    }
+};
+
+#endif
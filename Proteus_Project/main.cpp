@@ -15,29 +15,129 @@
 
 #include <vector>
 #include <string>
+
+#include "encoders.h"
+#include "loopTimer.h"
+#include "velocityPID.h"
+#include "motionProfile.h"
+#include "rpsCache.h"
+#include "odometry.h"
+#include "telemetry.h"
+#include "purePursuit.h"
+#include "scheduler.h"
+#include "runLog.h"
+#include "calibration.h"
+#include "battery.h"
+#include "optoArray.h"
+#include "display.h"
+#include "startLight.h"
+#include "cdsClassifier.h"
+#include "waypoints.h"
+#include "mission.h"
+#include "planner.h"
 // Motor equilibrium percentages, declared globally so they can be accessed inside and outside motion class. 
+// These are the feed forward for the wheel speed controllers, at BATTERY_NOMINAL_VOLTS. Overwritten at startup by the
+// last calibration on the SD card (see MotorCalibration), never changed during a run.
 
 float LEFTPERCENT = 58.4;
 float RIGHTPERCENT = -48.2;
 
-// Line following duration for tray task.  
-#define Time_Tray 1.3
-
-#define LINETHRESHHOLD 1.5
-
-// left and right boolean definitions for turning. 
+// Line following duration for tray task. Same distance as the old 1.3 s at the equilibrium speed, now that
+// following runs at LINE_FOLLOW_SPEED.
+#define Time_Tray 0.95
+
+// Time to hold a servo at its target once it gets there: tray dump, burger flip, ice cream lever.
+#define TRAY_DUMP_HOLD 0.4
+#define BURGER_FLIP_HOLD 0.3
+#define LEVER_HOLD 0.5
+
+// Optosensor voltages over the line and off it, left/mid/right. The opto snapshot scales readings between these.
+#define LEFT_OPTO_ON 2.3
+#define MID_OPTO_ON 1.3
+#define RIGHT_OPTO_ON 2.5
+#define LEFT_OPTO_OFF 0.18
+#define MID_OPTO_OFF 0.2
+#define RIGHT_OPTO_OFF 0.23
+// Below this much scaled signal across all three sensors the line is lost.
+#define LINE_MIN_SIGNAL 0.3
+// Position reported while the line is lost, on whichever side it was last seen (sensor spacings).
+#define LINE_LOST_POSITION 1.5
+// Line following speed (times the equilibrium), PD steering gains per sensor spacing and per spacing/s, and the
+// most the inside wheel gets slowed (1 stops it).
+#define LINE_FOLLOW_SPEED 1.4
+#define LINE_KP 0.45
+#define LINE_KD 0.04
+#define LINE_MAX_STEER 0.9
+
+// Waypoint capture: RPS fixes averaged per point, seconds after the tap before frames count (RPS lags), most
+// seconds spent collecting, how far (inches) a fix can be from the median before it's thrown out, and how long the
+// result stays on the screen before the next prompt.
+#define WAYPOINT_FRAMES 8
+#define WAYPOINT_SETTLE 0.25
+#define WAYPOINT_CAPTURE_TIMEOUT 2.5
+#define WAYPOINT_OUTLIER 0.5
+#define WAYPOINT_MESSAGE_TIME 1.0
+
+// left and right boolean definitions for turning.
 #define LEFT false
 #define RIGHT true
+
+// Stuck detection window for motions, in microseconds
+#define SPEED_WINDOW_US 400000
+
+// Encoder ticks per second each wheel makes at LEFTPERCENT/RIGHTPERCENT. Wheel speed targets are relative to this.
+#define NOMINAL_TICK_RATE 20.0
+// Motion profile limits in encoder ticks/s, ticks/s^2 and ticks/s^3. Drives cruise faster than NOMINAL_TICK_RATE
+// now that the start and end are ramped, turns cruise at 2/3 of it like they always have.
+#define DRIVE_MAX_VEL 25.0
+#define DRIVE_MAX_ACCEL 60.0
+#define TURN_MAX_VEL 13.3
+#define TURN_MAX_ACCEL 40.0
+#define PROFILE_MAX_JERK 400.0
+// Ticks/s taken off the target of whichever wheel is ahead, per tick it is ahead. Keeps straight lines straight.
+#define WHEEL_SYNC_GAIN 2.0
+// Path following stops steering inside DEST_STEER_MIN inches of the end, and never slows the inside wheel by more
+// than PATH_MAX_SPREAD of the speed (so it keeps rolling forward).
+#define DEST_STEER_MIN 2.0
+#define PATH_MAX_SPREAD 0.8
+// A path that starts further off to the side than this (degrees) gets a turn in place first.
+#define PATH_MAX_START_ANGLE 60.0
+// turnTo() tolerance, in heading steps: the heading change when one wheel moves one tick (about 3.7 degrees on
+// these wheels). Anything under half a step can sit between two readings it never gets to, and the turn hunts back
+// and forth; a bit over half leaves room for RPS noise.
+#define HEADING_TOLERANCE_STEPS 0.6
+// turnTo() gives up after turning back this many times.
+#define TURN_MAX_REVERSALS 3
+// Longest a motion will wait for a first RPS fix before giving up on it (seconds).
+#define RPS_WAIT_TIMEOUT 3.0
+// Motor calibration: the two speeds measured (times the current equilibrium), time to let the wheels get up to
+// speed, ticks timed at each speed (half a pinwheel turn), and how long to wait for them before giving up.
+#define CALIBRATION_LOW 0.8
+#define CALIBRATION_HIGH 1.2
+#define CALIBRATION_SETTLE 0.3
+#define CALIBRATION_TICKS 10
+#define CALIBRATION_TIMEOUT 2.0
+
+// Which motion the Motion task is running.
+#define DRIVE_FORWARD 0
+#define DRIVE_BACKWARDS 1
+#define TURN 2
+#define FOLLOW_PATH 3
+
+// LCD pages, see display.h. Motion summaries, optosensors while line following, CdS readings.
+#define PAGE_DRIVE 0
+#define PAGE_LINE 1
+#define PAGE_LIGHT 2
 /*
 Input pins/sensors/motors!
 */
 AnalogInputPin cdsSensor(FEHIO::P1_0);
-AnalogInputPin leftOpto(FEHIO::P0_2);
-AnalogInputPin midOpto(FEHIO::P0_1);
-AnalogInputPin rightOpto(FEHIO::P0_0);
+// Line following optosensors, left/mid/right. Only ever read through a snapshot, see optoArray.h
+OptoArray optos(FEHIO::P0_2, FEHIO::P0_1, FEHIO::P0_0);
 
-DigitalInputPin leftEncoder(FEHIO::P3_1);
-DigitalInputPin rightEncoder(FEHIO::P3_0);
+// Pinwheel encoders are counted by interrupt, see encoders.h
+Encoder leftEncoder(FEHIO::P3_1);
+Encoder rightEncoder(FEHIO::P3_0);
 
 FEHMotor leftMotor(FEHMotor::Motor0, 7.2);
 FEHMotor rightMotor(FEHMotor::Motor3, 7.2);
@@ -46,6 +146,93 @@ FEHServo trayServo(FEHServo::Servo0);
 FEHServo burgerServo(FEHServo::Servo7);
 FEHServo ticketServo(FEHServo::Servo1);
 
+/*
+    Run loop. Motions, line following and servo moves are all tasks on this scheduler,
+    so a servo can swing while the chassis drives. Use scheduler.sleep() instead of Sleep() during a run.
+*/
+Scheduler scheduler;
+
+// Run log. Everything that used to go to rpstrav.txt, data.txt and timing.txt, buffered in RAM and written to
+// this run's runNNN.log while the robot isn't driving.
+RunLog runLog(scheduler);
+
+// Everything the run puts on the LCD goes through here, drawn in the background a changed widget at a time.
+Display display(scheduler, runLog);
+// Bottom row on every page, for anything that has to be seen whatever else is on the screen.
+int statusRow = display.addText(DISPLAY_ALL_PAGES, 13, YELLOW);
+
+/*
+    RPS front end, and the pose estimate. Encoder odometry (0.51 in per tick, wheels 8 in apart) fused with RPS,
+    runs in the background on the scheduler. Always drive the motors through setDrive() so it knows which way the
+    wheels are turning. Read RPS through rps, never RPS.X() and friends directly.
+*/
+RpsCache rps;
+Odometry odometry(leftEncoder, rightEncoder, (M_PI * 3.25) / 20.0, 8.0, rps);
+
+// Counts, motor commands and RPS at 100 Hz during every primitive, for tuning. Written to tlmNNN.txt between motions.
+Telemetry telemetry(leftEncoder, rightEncoder, rps, scheduler);
+
+// Filtered battery voltage, sampled in the background. Every motor percent is scaled by it in setDrive(), so all
+// the percents in this file mean the same wheel speed on any pack.
+BatteryMonitor batteryMonitor(scheduler, runLog);
+
+// Start light detector. Also times the first motor command after the light, see setDrive().
+StartLight startLight(cdsSensor, scheduler, runLog);
+// Jukebox light colour, from a burst of CdS samples taken while driving up to it.
+CdsClassifier jukeboxReader(cdsSensor, scheduler);
+
+/**
+ * @brief Sets both drive motors and tells odometry which way each wheel is going. Percents are as they would be at
+ * BATTERY_NOMINAL_VOLTS, they get scaled for the battery on the way out.
+ *
+ * @param leftPercent Left motor percent
+ * @param rightPercent Right motor percent
+ */
+void setDrive(float leftPercent, float rightPercent)
+{
+    // Forward is whichever sign the equilibrium percentage has. Keep the last direction at 0, the wheel is still coasting that way.
+    if (leftPercent != 0.0)
+    {
+        odometry.leftSign = (leftPercent * LEFTPERCENT > 0.0) ? 1.0 : -1.0;
+    }
+    if (rightPercent != 0.0)
+    {
+        odometry.rightSign = (rightPercent * RIGHTPERCENT > 0.0) ? 1.0 : -1.0;
+    }
+    leftPercent = batteryMonitor.compensate(leftPercent);
+    rightPercent = batteryMonitor.compensate(rightPercent);
+    leftMotor.SetPercent(leftPercent);
+    rightMotor.SetPercent(rightPercent);
+    startLight.motorCommand(leftPercent, rightPercent);
+    telemetry.leftCommand = leftPercent;
+    telemetry.rightCommand = rightPercent;
+}
+
+/**
+ * @brief Stops both drive motors.
+ */
+void stopDrive()
+{
+    leftMotor.Stop();
+    rightMotor.Stop();
+    telemetry.leftCommand = 0.0;
+    telemetry.rightCommand = 0.0;
+}
+
+/**
+ * @brief Called by rps when RPS has been gone too long. Odometry carries on dead reckoning by itself, so all
+ * there is to do is let the team know. Runs inside the scheduler, must not block.
+ *
+ * @param state RPS_NO_FIX or RPS_DEADZONE
+ */
+void rpsLost(int state)
+{
+    display.setText(statusRow, state == RPS_DEADZONE ? "RPS DEADZONE, DEAD RECKON" : "RPS LOST, DEAD RECKONING");
+}
+ServoMove trayMove(trayServo, scheduler);
+ServoMove burgerMove(burgerServo, scheduler);
+ServoMove ticketMove(ticketServo, scheduler);
+
 /*
     Classes and methods
 */
@@ -55,22 +242,39 @@ FEHServo ticketServo(FEHServo::Servo1);
  *
  * The following functions are included in the motion class:
  * Motion(int revCounts) - constructor for the motion class, takes the number of counts (black/white portions) on the pinwheel
- * void debugEncoderValues(int time) - prints the encoder values T/F for the left and right motors for a given time
+ * void debugEncoderValues(int time) - prints the encoder counts for the left and right motors for a given time
+ * void resetCounts() - zeroes the left and right encoder counts
+ * void updateCounts() - pulls the latest interrupt counted ticks into leftCounts and rightCounts
  * void driveForwrad(float distance, bool dynamic) - drives the robot forward a given distance, with or without dynamic PID
  * void driveBackwards(float distance) - drives the robot backward a given distance
- * void turn(float degrees, bool dirrection) - turns the robot a given number of degrees, left or right
+ * void turn(float degrees, bool dirrection) - turns the robot a given number of degrees, left or right, on encoder counts alone. Use for pushing things.
+ * void turnTo(float heading) - turns the shortest way to a heading, closed loop on RPS and the encoders, done within headingTolerance
+ * startDriveForward(), startDriveBackwards(), startTurn(), startTurnTo() - same as above, but return right away and run on the scheduler
+ * bool step() - one pass of the control loop for the motion in progress, called by the scheduler
+ * leftPID, rightPID - per wheel speed controllers. Gains can be changed with setGains()
+ * profile - speed profile for the motion in progress, ramps the wheel speed targets up and down
  * void getRPSInfo(FEHFile *fptr) - gets 10 RPS data points and writes them to the LCD and a file
- * void travelTo(float destX, float destY, bool driveThere) - Uses RPS to align and drive to a given point. driveThere is a boolean (default value=true) which determines whether or not to drive there
- * void align(float heading) - aligns the robot to a given heading
+ * void travelTo(float destX, float destY, bool driveThere) - Uses the fused RPS/odometry pose to align and drive to a given point. driveThere is a boolean (default value=true) which determines whether or not to drive there
+ * void driveTo(float destX, float destY) - drives forward to a point, correcting distance and heading from the pose on the way
+ * void followPath(const float *xs, const float *ys, int count) - drives through a list of points without stopping, steering with pure pursuit
+ * void align(float heading) - aligns the robot to a given heading (same as turnTo)
+ * bool calibrate(MotorCalibration &result) - measures LEFTPERCENT and RIGHTPERCENT, then backs up to where it started
  */
-class Motion
+class Motion : public Task
 {
 public:
     // encoder counts per revolution, left and right counts, times driveForward is called.
     int countsPerRev, leftCounts, rightCounts, timesCalled;
-    FEHFile *rpsTravelLog;
     // Circumference of wheel = PI*D
     float distPerRev = M_PI * 3.25;
+    // Wheel speed controllers. State is reset at the start of every motion.
+    VelocityPID leftPID, rightPID;
+    // Acceleration limited speed profile, planned at the start of every closed loop motion.
+    MotionProfile profile;
+    // turnTo() is done once the heading is within this many degrees.
+    float headingTolerance;
+    // Set if the last motion gave up: the wheels stopped turning, or turnTo() kept overshooting.
+    bool stalled;
     /**
      * @brief Construct a new Motion object
      *
@@ -82,10 +286,17 @@ public:
         leftCounts = 0;
         rightCounts = 0;
         timesCalled = 0;
-        rpsTravelLog = SD.FOpen("rpstrav.txt", "w+");
+        headingTolerance = HEADING_TOLERANCE_STEPS * (odometry.inchesPerTick / odometry.trackWidth) * 180.0 / M_PI;
+        stalled = false;
+        toHeading = false;
+        reversals = 0;
+        control = true;
+        percentRow = display.addText(PAGE_DRIVE, 0);
+        distanceRow = display.addText(PAGE_DRIVE, 1);
+        timingRow = display.addText(PAGE_DRIVE, 2);
     }
     /**
-     * @brief writes the left and right digital optosensor values to the screen every 2s for a set amount of time
+     * @brief writes the left and right encoder counts (and rejected glitches) to the screen every 2s for a set amount of time
      *
      * @param time
      *      -Time in seconds
@@ -93,226 +304,95 @@ public:
     void debugEncoderValues(int time)
     {
         double startTime = TimeNow();
+        resetCounts();
         while (TimeNow() - startTime <= time)
         {
+            updateCounts();
             LCD.Clear();
-            LCD.WriteLine("LEFT ENCODER VALUE:");
-            LCD.WriteLine(leftEncoder.Value());
-            LCD.WriteLine("RIGHT ENCODER VALUE:");
-            LCD.WriteLine(rightEncoder.Value());
+            LCD.WriteLine("LEFT ENCODER COUNTS:");
+            LCD.WriteLine(leftCounts);
+            LCD.WriteLine("RIGHT ENCODER COUNTS:");
+            LCD.WriteLine(rightCounts);
+            LCD.WriteLine("GLITCHES REJECTED L/R:");
+            LCD.WriteLine(leftEncoder.rejected);
+            LCD.WriteLine(rightEncoder.rejected);
             Sleep(2.0);
         }
     }
+    /**
+     * @brief Zeroes the left and right encoder counts. Call at the start of every motion.
+     */
+    void resetCounts()
+    {
+        leftEncoder.ResetCounts();
+        rightEncoder.ResetCounts();
+        leftCounts = 0;
+        rightCounts = 0;
+    }
+    /**
+     * @brief Pulls the ticks the encoder interrupts have counted since the last call into leftCounts and rightCounts.
+     * Ticks are counted in the background, so it doesn't matter how long the loop body between calls takes.
+     */
+    void updateCounts()
+    {
+        leftEncoder.Update();
+        rightEncoder.Update();
+        leftCounts = leftEncoder.Counts();
+        rightCounts = rightEncoder.Counts();
+    }
     /**
      * @brief implementation of driveForward using shaft encoding.
-     *     will dynamically update left and right motor percentages for
-     *     straight driving. Logs counts vs time data to a file every time function is called.
+     *     with dynamic on, each wheel's speed is held at the target by its own PID for
+     *     straight driving. Blocks until the robot gets there, but servo moves and other tasks keep running meanwhile.
      *
      * @param distance
      *          - The desired distance
      * @param dynamic
-     *          -TRUE to dynamically change motor speeds.
+     *          -TRUE for closed loop wheel speed control. FALSE drives at the equilibrium percentages, use this when pushing into something.
      *
      */
     void driveForward(float distance, bool dynamic)
     {
+        startDriveForward(distance, dynamic);
+        scheduler.waitFor(this);
+    }
 
-        /*
-        Create and open rht###.txt and lft###.txt for writing counts data to be graphed in matlab
-        Can be called at max 999 times without buffer overflow error.
-        NVM, old idea im not implementing this. Too slow.
-        */
-        /**
-         timesCalled++;
-         char fileNum[7], leftFile[11], rightFile[11];
-         sprintf(fileNum, "%d.txt", timesCalled);
-         strcpy(leftFile, "lft");
-         strcpy(rightFile, "rht");
-         strcat(leftFile, fileNum);
-         strcat(rightFile, fileNum);
-         //FEHFile *leftData = SD.FOpen(leftFile, "w+");
-         FEHFile *rightData = SD.FOpen(rightFile, "w+");
-         */
-        int requiredCounts = (distance / distPerRev) * countsPerRev;
-        leftCounts = 0;
-        rightCounts = 0;
-        float rpsX;
-        float rpsY;
-        float rpsChange;
-        // Times left and right wheel become stuck, used for infinite loop termination.
-        int stuckCounts = 0;
-        // Current values of left and right digital optosensors
-        int leftCurrent = leftEncoder.Value();
-        int rightCurrent = rightEncoder.Value();
-        // Counts per 0.4 seconds of right and left wheel.
-        int rightCPQS = 0, leftCPQS = 0;
-        // Interval time used for dynamic robot speed change (DRSC) and data logging interval
-        double intervalTime = TimeNow();
-        // double dataLogInterval = TimeNow();
-        double startTime = TimeNow(), elapsedTime;
-        // Start her up
-        leftMotor.SetPercent(LEFTPERCENT);
-        rightMotor.SetPercent(RIGHTPERCENT);
-        rpsX = RPS.X();
-        rpsY = RPS.Y();
-        // While average of left and right counts are less than counts for a desired distance, continue.
-        while (((leftCounts + rightCounts) / 2) < requiredCounts)
-        {
-            // If left optosensor switches from a 0 to a 1 or vice versa, update left current value and add 1 to leftCounts
-
-            if (leftCurrent != leftEncoder.Value())
-            {
-                leftCurrent = leftEncoder.Value();
-                leftCounts++;
-                leftCPQS++;
-            }
-            if (rightCurrent != rightEncoder.Value())
-            {
-                rightCurrent = rightEncoder.Value();
-                rightCounts++;
-                rightCPQS++;
-            }
-            /*
-                // Log left and right counts data to file every 0.1 seconds.
-                if (TimeNow() - dataLogInterval >= 0.1)
-                {
-                    SD.FPrintf(leftData, "%f\t%d\n", TimeNow() - startTime, leftCounts);
-                    SD.FPrintf(rightData, "%f\t%d\n", TimeNow() - startTime, rightCounts);
-                    dataLogInterval = TimeNow();
-                }
-            */
-            if (TimeNow() - intervalTime >= 0.40)
-            {
-
-                /*
-                    If right wheel is moving faster than left wheel,
-                    increase speed of left wheel by the ratio of rightCounts/leftCounts.
-                    If left wheel is moving faster than right wheel,
-                    decrease speed of left wheel by ratio leftCounts/rightCounts
-                    if speeds are relatively even, will change little, but if speeds are uneven, will change a lot.
-                */
-                rpsChange = sqrt(pow(RPS.X() - rpsX, 2) + pow(RPS.Y() - rpsY, 2));
-
-                if (leftCPQS == 0 && rightCPQS == 0)
-                {
-                    stuckCounts++;
-                }
-                if (rightCPQS == 0)
-                {
-                    rightCPQS++;
-                }
-                if (leftCPQS == 0)
-                {
-                    leftCPQS++;
-                }
-
-                if (dynamic)
-                {
-                    /**
-                     * The math behind the dynamic speed change:
-                     * Compensate for count difference by meeting in the middle and adjusting percentages of wheels
-                     * Calculation:
-                     * Needed CPQS change for each wheel = |rightCPQS-leftCPQS|/2
-                     * rightMotor unit CPQS change = rightCPQS/rightpercent
-                     * same for left
-                     * Needed Percentage change for each wheel = Needed CPQS change/unit CPQS change
-                     * As left and right CPQS draw closer together, the percent changes will near zero.
-                     * As left and right CPQS become farther apart, the percent changes will increase.
-                     */
-                    if (rpsChange > 0.4)
-                    {
-                        if (rightCPQS > leftCPQS)
-                        {
-
-                            // Make Right Smaller, left larger
-
-                            LEFTPERCENT += ((rightCPQS - leftCPQS) * LEFTPERCENT) / (2.0 * leftCPQS);
-
-                            RIGHTPERCENT -= ((rightCPQS - leftCPQS) * RIGHTPERCENT) / (2.0 * rightCPQS);
-                        }
-
-                        else if (leftCPQS > rightCPQS)
-                        {
-                            // Make right larger, left smaller
-
-                            LEFTPERCENT -= ((leftCPQS - rightCPQS) * LEFTPERCENT) / (2.0 * leftCPQS);
-
-                            RIGHTPERCENT += ((leftCPQS - rightCPQS) * RIGHTPERCENT) / (2.0 * rightCPQS);
-                        }
-                    }
-                }
-                // Change left percent to new value, set left and right counts per half sec to 0;
-                leftMotor.SetPercent(LEFTPERCENT);
-                rightMotor.SetPercent(RIGHTPERCENT);
-                rightCPQS = 0;
-                leftCPQS = 0;
-                intervalTime = TimeNow();
-            }
-            // If robot is stuck and remains stuck, terminate.
-            if (stuckCounts > 4)
-            {
-                requiredCounts = 0;
-            }
-        }
-
-        leftMotor.Stop();
-        rightMotor.Stop();
-        elapsedTime = TimeNow() - startTime;
-        LCD.Clear();
-
-        LCD.WriteLine("NEW LEFT PERCENT: ");
-        LCD.WriteLine(LEFTPERCENT);
-        LCD.WriteLine("RIGHT PERCENT:");
-        LCD.WriteLine(RIGHTPERCENT);
-        LCD.WriteLine("1)Distance driven 2) time(seconds)");
-        LCD.WriteLine(distance);
-        LCD.WriteLine(elapsedTime);
-        // SD.FClose(leftData);
-        // SD.FClose(rightData);
+    /**
+     * @brief Starts driving forward and returns right away. The drive runs as a task on the scheduler.
+     *
+     * @param distance
+     *          - The desired distance
+     * @param dynamic
+     *          -TRUE to dynamically change motor speeds.
+     */
+    void startDriveForward(float distance, bool dynamic)
+    {
+        // Counts vs time for every drive get recorded by telemetry and exported with Simulation/telemetryCsv,
+        // no more writing lft###.txt/rht###.txt from inside the drive.
+        begin(DRIVE_FORWARD, distance, (distance / distPerRev) * countsPerRev, 1.0, 1.0, DRIVE_MAX_VEL, DRIVE_MAX_ACCEL, dynamic);
     }
 
     /**
-     * @brief Shaft encoding implementation of backwards driving. Does not include dynamic speed change capability right now
+     * @brief Shaft encoding implementation of backwards driving, with closed loop wheel speed control.
      *
      * @param distance
      *          -The distance desired.
      */
     void driveBackwards(float distance)
     {
-        int requiredCounts = (distance / distPerRev) * countsPerRev;
-        leftCounts = 0;
-        rightCounts = 0;
-        // Current values of left and right digital optosensors
-        int leftCurrent = leftEncoder.Value();
-        int rightCurrent = rightEncoder.Value();
-        // Start time
-        double startTime = TimeNow(), elapsedTime;
-        // Start her up
-        leftMotor.SetPercent(-LEFTPERCENT);
-        rightMotor.SetPercent(-RIGHTPERCENT);
-        // While average of left and right counts are less than counts for a desired distance, continue.
-        while (((leftCounts + rightCounts) / 2) < requiredCounts)
-        {
-            // If left optosensor switches from a 0 to a 1 or vice versa, update left current value and add 1 to leftCounts
-            if (leftCurrent != leftEncoder.Value())
-            {
-                leftCurrent = leftEncoder.Value();
-                leftCounts++;
-            }
-            if (rightCurrent != rightEncoder.Value())
-            {
-                rightCurrent = rightEncoder.Value();
-                rightCounts++;
-            }
-        }
-        leftMotor.Stop();
-        rightMotor.Stop();
-        elapsedTime = TimeNow() - startTime;
-        LCD.Clear();
+        startDriveBackwards(distance);
+        scheduler.waitFor(this);
+    }
 
-        LCD.WriteLine("1)Distance driven 2) time(seconds)");
-        LCD.WriteLine(distance);
-        LCD.WriteLine(elapsedTime);
+    /**
+     * @brief Starts driving backwards and returns right away. The drive runs as a task on the scheduler.
+     *
+     * @param distance
+     *          -The distance desired.
+     */
+    void startDriveBackwards(float distance)
+    {
+        begin(DRIVE_BACKWARDS, distance, (distance / distPerRev) * countsPerRev, -1.0, -1.0, DRIVE_MAX_VEL, DRIVE_MAX_ACCEL, true);
     }
 
     /**
@@ -324,63 +404,135 @@ public:
      *      -Use global variable LEFT for left turn and RIGHT for right turn
      */
     void turn(float angle, bool direction)
+    {
+        startTurn(angle, direction);
+        scheduler.waitFor(this);
+    }
+
+    /**
+     * @brief Starts a turn and returns right away. The turn runs as a task on the scheduler.
+     *
+     * @param angle
+     *      -The angle for which to turn (in degrees)
+     * @param direction
+     *      -Use global variable LEFT for left turn and RIGHT for right turn
+     */
+    void startTurn(float angle, bool direction)
+    {
+        if (direction == LEFT)
+        {
+            begin(TURN, angle, turnCounts(angle), -1.0, 1.0, TURN_MAX_VEL, TURN_MAX_ACCEL, true);
+        }
+        else
+        {
+            begin(TURN, angle, turnCounts(angle), 1.0, -1.0, TURN_MAX_VEL, TURN_MAX_ACCEL, true);
+        }
+    }
+
+    /**
+     * @brief Encoder counts (per wheel) it takes to turn in place by an angle.
+     *
+     * @param angle Angle in degrees
+     */
+    float turnCounts(float angle)
     {
         /*
-        Wheelspan of robot is
+        Wheelspan of robot is 8 in
         */
-        leftCounts = 0;
-        rightCounts = 0;
-        int newRightCounts = 0;
-        int newLeftCounts = 0;
         float turnRadius = 4.0;
         float rads = (angle * M_PI) / 180.;
         // dist = r*Theta
         // revs = dist/circumference
         float revsRequired = (turnRadius * rads) / distPerRev;
-        int requiredCounts = revsRequired * countsPerRev;
-        int leftCurrent = leftEncoder.Value();
-        int rightCurrent = rightEncoder.Value();
-        int numTimeouts = 0;
-        if (direction == LEFT)
+        return revsRequired * countsPerRev;
+    }
+
+    /**
+     * @brief One pass of the control loop for whichever motion is running. Called by the scheduler.
+     *
+     * @return true once the motion is finished
+     */
+    bool step()
+    {
+        // Control loop runs at a fixed rate, in between the scheduler gets on with other tasks.
+        if (!loopTimer.due())
         {
-            leftMotor.SetPercent((-LEFTPERCENT * 2.0) / 3.0);
-            rightMotor.SetPercent((RIGHTPERCENT * 2.0) / 3.);
+            return false;
         }
-        else
+        // Ticks are counted by interrupt, just pick up whatever came in since last time.
+        updateCounts();
+        if (closedLoop)
         {
-            leftMotor.SetPercent((LEFTPERCENT * 2.0) / 3.);
-            rightMotor.SetPercent((-RIGHTPERCENT * 2.0) / 3.);
+            controlWheels();
         }
-        // While average of counts is less than the required number of counts, keep going
-        // No differentail changes on turns.
-        double intervalTime = 0.4;
-        while (((leftCounts + rightCounts) / 2.) <= requiredCounts && numTimeouts <= 4)
+        // Stuck check: if neither wheel ticks for a whole window, five windows in a row, give up.
+        if (MicrosNow() - intervalMicros >= SPEED_WINDOW_US)
         {
-            if (leftCurrent != leftEncoder.Value())
-            {
-                leftCurrent = leftEncoder.Value();
-                leftCounts++;
-                newLeftCounts++;
-            }
-            if (rightCurrent != rightEncoder.Value())
+            if (rightCounts == rightWindowStart && leftCounts == leftWindowStart)
             {
-                rightCurrent = rightEncoder.Value();
-                rightCounts++;
-                newRightCounts++;
+                stuckCounts++;
             }
-            if (TimeNow() - intervalTime >= 0.4)
+            else
             {
-                if (newRightCounts == 0 && newLeftCounts == 0)
-                {
-                    numTimeouts++;
-                }
-                intervalTime = TimeNow();
-                newRightCounts = 0;
-                newLeftCounts = 0;
+                stuckCounts = 0;
             }
+            intervalMicros = MicrosNow();
+            leftWindowStart = leftCounts;
+            rightWindowStart = rightCounts;
+        }
+        bool finished;
+        if (mode == TURN && toHeading)
+        {
+            finished = fabs(Odometry::angleDifference(targetHeading, odometry.heading)) <= headingTolerance;
+        }
+        else if (mode == TURN)
+        {
+            // While average of counts is less than the required number of counts, keep going
+            finished = ((leftCounts + rightCounts) / 2.) > requiredCounts;
+        }
+        else
+        {
+            // While average of left and right counts are less than counts for a desired distance, continue.
+            finished = ((leftCounts + rightCounts) / 2) >= requiredCounts;
+        }
+        loopTimer.done();
+        stalled = !finished && (stuckCounts > 4 || reversals > TURN_MAX_REVERSALS);
+        return finished || stalled;
+    }
+
+    /**
+     * @brief Stops the motors when a motion finishes (or is cancelled) and shows how it went.
+     */
+    void end()
+    {
+        stopDrive();
+        telemetry.endSegment();
+        double elapsedTime = (MicrosNow() - startMicros) / 1000000.0;
+        loopTimer.log(runLog, mode);
+        // Only goes on the screen once the display gets round to it, nothing here waits for the LCD.
+        char line[48];
+        display.showPage(PAGE_DRIVE);
+        if (mode != TURN && closedLoop)
+        {
+            sprintf(line, "FINAL L/R %% %.1f %.1f", leftPID.output, rightPID.output);
+            display.setText(percentRow, line);
+        }
+        else
+        {
+            display.setText(percentRow, "");
+        }
+        if (mode != TURN)
+        {
+            sprintf(line, "DIST %.2f TIME %.2f", distance, elapsedTime);
+            display.setText(distanceRow, line);
+        }
+        else
+        {
+            display.setText(distanceRow, "");
         }
-        leftMotor.Stop();
-        rightMotor.Stop();
+        // Loop timing: mean period, worst jitter, worst iteration (us), overruns
+        loopTimer.summary(line);
+        display.setText(timingRow, line);
     }
 
     /**
@@ -403,13 +555,10 @@ public:
             {
             }
             LCD.Clear();
-            float heading = RPS.Heading() + 90.0;
-            if (heading >= 360.)
-            {
-                heading -= 360.;
-            }
-            adjustedX = RPS.X();
-            adjustedY = RPS.Y();
+            RpsSample sample = rps.current();
+            float heading = Odometry::fromRpsHeading(sample.heading);
+            adjustedX = sample.x;
+            adjustedY = sample.y;
 
             SD.FPrintf(fptr, "Point %d\n", count);
             SD.FPrintf(fptr, "X: %f\n", adjustedX);
@@ -434,192 +583,159 @@ public:
      * @param destX The RPS X destination coordinate
      * @param destY The RPS Y destination coordinate
      * @param driveThere Optional. Defaults to true. Set this to false if you want to orient to a point without driving to it.
+     *      When driving there, the robot curves onto the point (see followPath) rather than stopping to face it first.
      */
     void travelTo(float destX, float destY, bool driveThere = true)
     {
-        float xi, yi, xf, yf, angleI, angleF, angleTurn, travelDist, xOffset, yOffset, qrAngle;
-
-        bool atDest = false;
-        SD.FPrintf(rpsTravelLog, "\n");
-        while (RPS.X() == -1. || RPS.Y() == -1.)
-        {
-        }
-        if (RPS.X() == -2 || RPS.Y() == -2)
-        {
-            LCD.WriteLine("DEADZONE");
-            driveBackwards(6.0);
-        }
-        Sleep(0.4);
-        xi = RPS.X();
-        yi = RPS.Y();
-        angleI = RPS.Heading();
+        float xi, yi, xf, yf, angleI, angleF, angleTurn;
 
-        /*
-        Adjust for misalignment of QR code
-        */
-        angleI = RPS.Heading() + 90.0;
-        if (angleI >= 360.)
+        // Pose comes from odometry, which keeps itself up to date with RPS in the background. No need to sit still
+        // and wait for RPS to settle, only to wait for the very first fix.
+        if (!waitForPose())
         {
-            angleI -= 360.;
+            runLog.add(LOG_NO_RPS, LOG_TRAVEL_TO, destX, destY);
+            return;
         }
-
-        xi = RPS.X();
-        yi = RPS.Y();
+        angleI = odometry.heading;
+        xi = odometry.x;
+        yi = odometry.y;
         // Think travel dist will work. x,y coords are supposed to be in inches.
         // Update: It does.
         xf = destX - xi;
         yf = destY - yi;
-        SD.FPrintf(rpsTravelLog, "\tRan travelTo(%f,%f)\n", destX, destY);
-        SD.FPrintf(rpsTravelLog, "I think I am at ( %f, %f ) facing %f deg\n", RPS.X(), RPS.Y(), angleI);
-        // Tree to find out which quadrant (xf,yf) is in. atan only returns angles (-pi/2,pi/2)
-        if (xf >= 0.)
+        runLog.add(LOG_TRAVEL_TO, driveThere, destX, destY);
+        runLog.add(LOG_START_POSE, 0, xi, yi, angleI);
+        if (driveThere)
         {
-            // 1st and 4th quadrants
-            if (xf == 0.)
-            {
-                // Xf is zero so can't use arctan. if yf is positive we align to 90 degrees if yf is negative we align to 270 degrees.
-                // If yf is also zero, then I guess we're at the destination?
-                if (yf > 0.)
-                {
-                    angleF = 90.0;
-                }
-                else if (yf < 0)
-                {
-                    angleF = 270.0;
-                }
-                else
-                {
-                    // Well this is akward, we are already where we want to be.(xf,yf)=(xi,yi)=(0,0)
-                    angleF = angleI;
-                    atDest = true;
-                }
-            }
-            else if (yf > 0.)
-            {
-                // First quadrant. atan functions as desired.
-                angleF = atan(yf / xf);
-                angleF = angleF * (180.0 / M_PI);
-            }
-            else if (yf < 0.)
-            {
-                // Fourth quadrant. arctan will return negative values. 360-abs(atan(yf/xf) will give what we want
-                angleF = atan(yf / xf);
-                angleF = angleF * (180.0 / M_PI);
-                angleF = 360.0 - abs(angleF);
-            }
-            else
-            {
-                // yf is zero and xf is positive. We are aligning to 0 degrees.
-                angleF = 0.0;
-            }
+            // No need to stop and face the point first, the path follower curves onto it.
+            trackPath(&destX, &destY, 1);
+            return;
         }
-        else
+        if (odometry.distanceTo(destX, destY) < 0.1)
         {
-            // 2nd and 3rd quadrants
-            if (yf > 0.)
-            {
-                // 2nd quadrant(-x+y)
-                // 180 - abs(angle) will give desired angle
-                angleF = atan(yf / xf);
-                angleF = angleF * (180.0 / M_PI);
-                angleF = 180.0 - abs(angleF);
-            }
-            else if (yf < 0.)
-            {
-                // 3rd quadrant(-x,-y)
-                // atan will be positive, 180+angle will give desired angle. adding abs() because I can
-                angleF = atan(yf / xf);
-                angleF = angleF * (180.0 / M_PI);
-                angleF = 180.0 + abs(angleF);
-            }
-            else
-            {
-                // Y is zero, xf is negative. We are aligning to 180 degrees.
-                angleF = 180.0;
-            }
+            // Well this is akward, we are already where we want to be.
+            return;
         }
-        // Turn in the optimal direction
-        angleTurn = angleI - angleF;
+        // Turn in the optimal direction, one closed loop turn straight onto the heading.
+        angleF = odometry.bearingTo(destX, destY);
+        angleTurn = Odometry::angleDifference(angleF, angleI);
+        runLog.add(LOG_TURN, 0, xf, yf, angleTurn);
+        turnTo(angleF);
+        // we are now aligned with our destination.
+        runLog.add(LOG_ARRIVED, 0, odometry.x, odometry.y, odometry.heading);
+    }
 
-        if (!atDest)
-        {
+    /**
+     * @brief Drives forward to a point. Like driveForward(), but the pose is checked every control tick, so the
+     * distance left is kept up to date and the robot steers back onto the point if it drifts off line.
+     *
+     * @param destX The RPS X destination coordinate
+     * @param destY The RPS Y destination coordinate
+     */
+    void driveTo(float destX, float destY)
+    {
+        startFollowPath(&destX, &destY, 1);
+        scheduler.waitFor(this);
+    }
 
-            if (angleTurn > 0.)
-            {
-                SD.FPrintf(rpsTravelLog, "Must travel to the relative coord ( %f, %f ) and turn %f deg right\n", xf, yf, angleTurn);
-                turn(angleTurn, RIGHT);
-            }
-            else if (angleTurn < 0)
-            {
-                SD.FPrintf(rpsTravelLog, "Must travel to the relative coord ( %f, %f ) and turn %f deg left\n", xf, yf, abs(angleTurn));
-                turn(abs(angleTurn), LEFT);
-            }
-            Sleep(0.4);
-            angleI = RPS.Heading() + 90.0;
-            if (angleI >= 360.0)
-            {
-                angleI -= 360.0;
-            }
-            // Fine tune orientation to align with dest better.
-            int count = 0;
-            while ((abs(angleI - angleF) > 6.0 && abs(angleI - angleF) < 353.0) && (count <= 5))
-            {
-                LCD.WriteLine("ALIGNING");
+    /**
+     * @brief Drives through a list of points one after the other without stopping at any of them. Both wheels are
+     * driven at different speeds to curve onto the path (pure pursuit), so corners get cut smoothly. If the first
+     * point is way off to the side the robot turns toward it in place first, and the same at any corner too sharp to
+     * drive round (see trackPath()). Logs a LOG_ARRIVED record with where it ended up.
+     *
+     * @param xs RPS X coordinates of the points
+     * @param ys RPS Y coordinates of the points
+     * @param count Number of points (at most MAX_PATH_POINTS)
+     */
+    void followPath(const float *xs, const float *ys, int count)
+    {
+        if (!waitForPose())
+        {
+            runLog.add(LOG_NO_RPS, LOG_FOLLOW_PATH, xs[count - 1], ys[count - 1]);
+            return;
+        }
+        runLog.add(LOG_FOLLOW_PATH, count, xs[count - 1], ys[count - 1]);
+        runLog.add(LOG_START_POSE, 0, odometry.x, odometry.y, odometry.heading);
+        trackPath(xs, ys, count);
+    }
 
-                if (abs(angleI - angleF) < 180.0)
-                {
+    /**
+     * @brief Starts following a path from wherever the robot is and returns right away. Runs as a task on the scheduler.
+     */
+    void startFollowPath(const float *xs, const float *ys, int count)
+    {
+        path.start(odometry.x, odometry.y, xs, ys, count);
+        float travelDist = path.remaining(odometry.x, odometry.y);
+        begin(FOLLOW_PATH, travelDist, (travelDist / distPerRev) * countsPerRev, 1.0, 1.0, DRIVE_MAX_VEL, DRIVE_MAX_ACCEL, true);
+    }
 
-                    if (angleI > angleF)
-                    {
+    /**
+     * @brief Makes sure odometry has a pose to work from. Once it has had one RPS fix it dead reckons through any
+     * dropout, so this only ever waits before the first fix, and then only up to RPS_WAIT_TIMEOUT.
+     *
+     * @return false if there is still no pose, in which case the motion should be skipped
+     */
+    bool waitForPose()
+    {
+        if (odometry.hasFix)
+        {
+            return true;
+        }
+        if (rps.current().state == RPS_DEADZONE)
+        {
+            display.setText(statusRow, "DEADZONE");
+            driveBackwards(6.0);
+        }
+        if (rps.waitForFix(scheduler, RPS_WAIT_TIMEOUT))
+        {
+            odometry.fuse();
+        }
+        return odometry.hasFix;
+    }
 
-                        turn(4.0, RIGHT);
-                    }
-                    else
-                    {
-                        turn(4.0, LEFT);
-                    }
-                }
-                // Handles cases where angleI and angleF are on other sides of the 359-0 degree line.
-                else
-                {
-                    if (angleI > angleF)
-                    {
-                        turn(4.0, LEFT);
-                    }
-                    else
-                    {
-                        turn(4.0, RIGHT);
-                    }
-                }
-                Sleep(0.35);
-                angleI = RPS.Heading() + 90.0;
-                if (angleI >= 360.0)
+    /**
+     * @brief Body of followPath() and travelTo(): follows the path a stretch at a time and logs where the robot
+     * ended up. A stretch ends at any corner sharper than PATH_MAX_START_ANGLE. Pure pursuit can't turn tighter than
+     * PATH_MAX_SPREAD lets it, so it swings wide round those and ends up inches off a short leg after one. The robot
+     * stops at the corner instead and turns in place, same as at the start when the first point is way off to the
+     * side.
+     */
+    void trackPath(const float *xs, const float *ys, int count)
+    {
+        float fromX = odometry.x, fromY = odometry.y;
+        int from = 0;
+        while (from < count)
+        {
+            // Points up to the next sharp corner. The corner at point i is between where the path comes into it from
+            // and where it goes next.
+            int to = from + 1;
+            while (to < count)
+            {
+                float inX = to - 1 > 0 ? xs[to - 2] : fromX, inY = to - 1 > 0 ? ys[to - 2] : fromY;
+                float in = atan2(ys[to - 1] - inY, xs[to - 1] - inX) * 180.0 / M_PI;
+                float out = atan2(ys[to] - ys[to - 1], xs[to] - xs[to - 1]) * 180.0 / M_PI;
+                if (fabs(Odometry::angleDifference(out, in)) > PATH_MAX_START_ANGLE)
                 {
-                    angleI -= 360.0;
+                    break;
                 }
-                count++;
+                to++;
             }
-            // we are now aligned with our destination.
-            // Get new initial position values to make sure that dist traveled is still right after the turn.
-            xi = RPS.X();
-            yi = RPS.Y();
-            xf = destX - xi;
-            yf = destY - yi;
-            travelDist = sqrt(pow(xf, 2) + pow(yf, 2));
-            if (driveThere)
+            float angleTurn = Odometry::angleDifference(odometry.bearingTo(xs[from], ys[from]), odometry.heading);
+            if (fabs(angleTurn) > PATH_MAX_START_ANGLE)
             {
-                driveForward(travelDist, true);
+                runLog.add(LOG_TURN, from, xs[from] - odometry.x, ys[from] - odometry.y, angleTurn);
+                turnTo(odometry.bearingTo(xs[from], ys[from]));
             }
-
-            float newAngle = RPS.Heading() + 90.0;
-            if (newAngle >= 360.0)
+            startFollowPath(xs + from, ys + from, to - from);
+            scheduler.waitFor(this);
+            if (stalled || scheduler.expired())
             {
-                newAngle -= 360.0;
+                break;
             }
-            Sleep(0.4);
-            SD.FPrintf(rpsTravelLog, "I have arrived at (%f,%f) facing %f", RPS.X(), RPS.Y(), newAngle);
+            from = to;
         }
-        Sleep(0.2);
+        runLog.add(LOG_ARRIVED, 0, odometry.x, odometry.y, odometry.heading);
     }
 
     /**
@@ -629,21 +745,274 @@ public:
      */
     void align(float heading)
     {
-        float turnAngle, currentHeading = RPS.Heading() + 90.0;
+        turnTo(heading);
+    }
 
-        if (currentHeading >= 360)
-        {
-            currentHeading -= 360;
-        }
-        turnAngle = currentHeading - heading;
-        if (turnAngle > 0)
+    /**
+     * @brief Turns in place to a heading on the course, the shortest way round.
+     *
+     * @param heading The heading in degrees (0-360, counterclockwise from +x, same as odometry).
+     */
+    void turnTo(float heading)
+    {
+        if (!waitForPose())
         {
-            turn(turnAngle, RIGHT);
+            return;
+        }
+        startTurnTo(heading);
+        scheduler.waitFor(this);
+    }
+
+    /**
+     * @brief Starts a turn to a heading and returns right away. The turn runs as a task on the scheduler.
+     *
+     * Closed loop on the fused pose: every control tick the shortest angle still to go sets how far the speed
+     * profile has left, so the turn slows down as it closes in, and turns back if it overshoots. Done once within
+     * headingTolerance degrees, or stalled if it has turned back more than TURN_MAX_REVERSALS times.
+     */
+    void startTurnTo(float heading)
+    {
+        float angle = Odometry::angleDifference(heading, odometry.heading);
+        if (angle > 0.0)
+        {
+            begin(TURN, angle, turnCounts(angle), -1.0, 1.0, TURN_MAX_VEL, TURN_MAX_ACCEL, true);
         }
         else
         {
-            turn(abs(turnAngle), LEFT);
+            begin(TURN, -angle, turnCounts(-angle), 1.0, -1.0, TURN_MAX_VEL, TURN_MAX_ACCEL, true);
+        }
+        toHeading = true;
+        targetHeading = Odometry::wrap360(heading);
+    }
+
+    /**
+     * @brief Measures the motor equilibrium percentages. Drives forward open loop at CALIBRATION_LOW and then
+     * CALIBRATION_HIGH times the current ones, times CALIBRATION_TICKS ticks of each wheel at each speed, and works
+     * out the percent that turns each wheel at NOMINAL_TICK_RATE. Then backs up to where it started on the new
+     * numbers. Takes about 4 seconds and 16 inches of clear floor.
+     *
+     * @param result Set to the new percentages
+     * @return true if it worked, in which case LEFTPERCENT and RIGHTPERCENT have been updated. false if a wheel
+     *      didn't turn or the numbers can't be right, and they are left alone.
+     */
+    bool calibrate(MotorCalibration &result)
+    {
+        float scale[2] = {CALIBRATION_LOW, CALIBRATION_HIGH};
+        float leftRate[2] = {0.0, 0.0}, rightRate[2] = {0.0, 0.0};
+        bool ok = true;
+        resetCounts();
+        for (int i = 0; i < 2 && ok; i++)
+        {
+            setDrive(scale[i] * LEFTPERCENT, scale[i] * RIGHTPERCENT);
+            ok = measureRates(leftRate[i], rightRate[i]);
+            runLog.add(LOG_CALIBRATION, i, scale[i] * LEFTPERCENT, scale[i] * RIGHTPERCENT, leftRate[i], rightRate[i]);
+        }
+        stopDrive();
+        if (ok)
+        {
+            result.leftPercent = MotorCalibration::solve(scale[0] * LEFTPERCENT, leftRate[0], scale[1] * LEFTPERCENT, leftRate[1], NOMINAL_TICK_RATE);
+            result.rightPercent = MotorCalibration::solve(scale[0] * RIGHTPERCENT, rightRate[0], scale[1] * RIGHTPERCENT, rightRate[1], NOMINAL_TICK_RATE);
+            ok = MotorCalibration::sane(result.leftPercent) && MotorCalibration::sane(result.rightPercent);
         }
+        runLog.add(LOG_CALIBRATION, 2, result.leftPercent, result.rightPercent, ok);
+        if (ok)
+        {
+            LEFTPERCENT = result.leftPercent;
+            RIGHTPERCENT = result.rightPercent;
+        }
+        // Let it roll to a stop before backing up.
+        scheduler.sleep(0.3);
+        updateCounts();
+        driveBackwards(((leftCounts + rightCounts) / 2.0) * distPerRev / countsPerRev);
+        return ok;
+    }
+
+private:
+    // Which motion is running, and the state it keeps between passes of the control loop.
+    int mode, requiredCounts;
+    float distance;
+    // Closed loop speed control on/off, wanted wheel speed in ticks/s, wheel directions (+1 forward, -1 back).
+    bool closedLoop;
+    float targetRate, leftDir, rightDir;
+    // Times left and right wheel become stuck, used for infinite loop termination.
+    int stuckCounts;
+    // Counts at the start of the current 0.4 second window.
+    int leftWindowStart, rightWindowStart;
+    // Stuck detection window start, motion start and last controller update, in microseconds
+    unsigned long intervalMicros, startMicros, lastControlMicros;
+    // Fixed rate tick and timing stats for the control loop
+    LoopTimer loopTimer;
+    // LCD rows for the summary at the end of each motion.
+    int percentRow, distanceRow, timingRow;
+    // Path being followed in FOLLOW_PATH mode.
+    PurePursuit path;
+    // Set for turnTo(): the heading being turned to, and how many times it has overshot and turned back.
+    bool toHeading;
+    float targetHeading;
+    int reversals;
+
+    /**
+     * @brief Resets the motion state and wheel controllers, starts the motors and puts this motion on the scheduler.
+     *
+     * @param newMode DRIVE_FORWARD, DRIVE_BACKWARDS or TURN
+     * @param newDistance Distance (or angle) for the LCD summary
+     * @param counts Average encoder counts at which the motion is done
+     * @param left Left wheel direction, 1 forward -1 backward
+     * @param right Right wheel direction, 1 forward -1 backward
+     * @param maxVel Cruise wheel speed in ticks/s
+     * @param maxAcc Wheel acceleration limit in ticks/s^2
+     * @param closed true for closed loop, profiled wheel speed control. false runs at the equilibrium percentages.
+     */
+    void begin(int newMode, float newDistance, int counts, float left, float right, float maxVel, float maxAcc, bool closed)
+    {
+        if (running)
+        {
+            scheduler.cancel(this);
+        }
+        mode = newMode;
+        distance = newDistance;
+        requiredCounts = counts;
+        leftDir = left;
+        rightDir = right;
+        closedLoop = closed;
+        toHeading = false;
+        reversals = 0;
+        profile.setLimits(maxVel, maxAcc, PROFILE_MAX_JERK);
+        profile.start(counts);
+        targetRate = closedLoop ? profile.velocity : NOMINAL_TICK_RATE;
+        resetCounts();
+        // Feed forward: the equilibrium percentage is what it takes to hold NOMINAL_TICK_RATE.
+        leftPID.reset(fabs(LEFTPERCENT) / NOMINAL_TICK_RATE);
+        rightPID.reset(fabs(RIGHTPERCENT) / NOMINAL_TICK_RATE);
+        stuckCounts = 0;
+        stalled = false;
+        leftWindowStart = 0;
+        rightWindowStart = 0;
+        loopTimer.start();
+        startMicros = MicrosNow();
+        intervalMicros = startMicros;
+        lastControlMicros = startMicros;
+        // No room on the scheduler means nothing would run the control loop, so the motors don't get started.
+        if (!scheduler.start(this))
+        {
+            stopDrive();
+            stalled = true;
+            runLog.add(LOG_SCHEDULER_FULL, mode);
+            return;
+        }
+        telemetry.beginSegment(mode);
+        // Start her up
+        setDrive(leftDir * (targetRate / NOMINAL_TICK_RATE) * LEFTPERCENT, rightDir * (targetRate / NOMINAL_TICK_RATE) * RIGHTPERCENT);
+    }
+
+    /**
+     * @brief For calibrate(): waits CALIBRATION_SETTLE for the wheels to get up to speed at whatever they've been
+     * set to, then times CALIBRATION_TICKS ticks of each, from a tick to a tick. Polls the encoders flat out the
+     * whole time so every tick gets timestamped within a few microseconds of when it happened.
+     *
+     * @return false if a wheel didn't make its ticks within CALIBRATION_TIMEOUT
+     */
+    bool measureRates(float &leftRate, float &rightRate)
+    {
+        double settled = TimeNow() + CALIBRATION_SETTLE;
+        while (TimeNow() < settled)
+        {
+            updateCounts();
+        }
+        int leftSeen = leftCounts, rightSeen = rightCounts;
+        int leftFrom = -1, rightFrom = -1;
+        unsigned long leftStart = 0, rightStart = 0;
+        leftRate = 0.0;
+        rightRate = 0.0;
+        double giveUp = TimeNow() + CALIBRATION_TIMEOUT;
+        while ((leftRate == 0.0 || rightRate == 0.0) && TimeNow() < giveUp)
+        {
+            updateCounts();
+            timeTicks(leftEncoder, leftSeen, leftFrom, leftStart, leftRate);
+            timeTicks(rightEncoder, rightSeen, rightFrom, rightStart, rightRate);
+        }
+        return leftRate > 0.0 && rightRate > 0.0;
+    }
+
+    /**
+     * @brief measureRates() bookkeeping for one wheel: the first new tick starts the clock, CALIBRATION_TICKS more
+     * stop it.
+     */
+    void timeTicks(Encoder &encoder, int &seen, int &from, unsigned long &start, float &rate)
+    {
+        int counts = encoder.Counts();
+        if (counts == seen || rate > 0.0)
+        {
+            return;
+        }
+        seen = counts;
+        if (from < 0)
+        {
+            from = counts;
+            start = encoder.lastTickMicros;
+        }
+        else if (counts - from >= CALIBRATION_TICKS)
+        {
+            rate = (counts - from) * 1000000.0 / (encoder.lastTickMicros - start);
+        }
+    }
+
+    /**
+     * @brief One wheel speed controller update. The profile gives the speed to aim for, each wheel's PID holds it
+     * there, and whichever wheel has counted more ticks gets its target lowered a bit (and the other raised) so
+     * the two stay in step. When following a path the wheels are steered along it off the pose instead.
+     */
+    void controlWheels()
+    {
+        unsigned long now = MicrosNow();
+        float dt = (now - lastControlMicros) / 1000000.0;
+        lastControlMicros = now;
+        float travelled = (leftCounts + rightCounts) / 2.0;
+        if (mode == FOLLOW_PATH)
+        {
+            // Distance left is measured along the path from the pose, so slips and RPS corrections are taken up
+            // by the profile, and the drive finishes once the robot is level with the last point.
+            float remaining = path.remaining(odometry.x, odometry.y);
+            requiredCounts = travelled + remaining / odometry.inchesPerTick;
+            profile.totalTicks = requiredCounts;
+            targetRate = profile.update(travelled, dt);
+            // Wheel speeds for the pure pursuit arc: v(1 -/+ k * track / 2). Heading feedback keeps the wheels in step.
+            float spread = 0.0;
+            if (remaining > DEST_STEER_MIN)
+            {
+                spread = path.curvature(odometry.x, odometry.y, odometry.heading) * odometry.trackWidth / 2.0;
+                spread = fmax(-PATH_MAX_SPREAD, fmin(PATH_MAX_SPREAD, spread));
+            }
+            float leftOut = leftPID.update(targetRate * (1.0 - spread), leftEncoder.TickRate(), dt);
+            float rightOut = rightPID.update(targetRate * (1.0 + spread), rightEncoder.TickRate(), dt);
+            setDrive(LEFTPERCENT < 0 ? -leftOut : leftOut, RIGHTPERCENT < 0 ? -rightOut : rightOut);
+            return;
+        }
+        if (toHeading)
+        {
+            float error = Odometry::angleDifference(targetHeading, odometry.heading);
+            // Overshot, turn back the other way. rightDir is +1 on a left turn.
+            if ((error > 0.0) != (rightDir > 0.0) && fabs(error) > headingTolerance)
+            {
+                leftDir = -leftDir;
+                rightDir = -rightDir;
+                reversals++;
+                resetCounts();
+                travelled = 0.0;
+                profile.start(0.0);
+                leftPID.reset(leftPID.feedForward);
+                rightPID.reset(rightPID.feedForward);
+            }
+            // Turn speed follows the angle still to go, from the pose rather than from the counts.
+            requiredCounts = travelled + turnCounts(fabs(error));
+            profile.totalTicks = requiredCounts;
+        }
+        targetRate = profile.update(travelled, dt);
+        float sync = WHEEL_SYNC_GAIN * (leftCounts - rightCounts);
+        float leftOut = leftPID.update(targetRate - sync, leftEncoder.TickRate(), dt);
+        float rightOut = rightPID.update(targetRate + sync, rightEncoder.TickRate(), dt);
+        // Percent sign follows the equilibrium percentage, right motor is mounted backwards.
+        setDrive(leftDir * (LEFTPERCENT < 0 ? -leftOut : leftOut), rightDir * (RIGHTPERCENT < 0 ? -rightOut : rightOut));
     }
 };
 
@@ -651,34 +1020,84 @@ public:
  * @brief LineFollowing class holds functions used for line following and debugging the analog optosensors. 
  * 
  * The following functions are included in the LineFollowing Class:
- * int getSensorState() - returns an integer representing the line detection state
+ * int getSensorState(const OptoSnapshot &seen) - returns an integer representing the line detection state
  * void debugOptoValues(double desiredTime) - Prints optosensor voltages for a desired amount of time. 
- * void displayOptoState() - Displays a graphic showing which optosensors are currently detecting a line.
- * void follow(double time) - Follows a line for a desired amount of time.
- * 
+ * void displayOptoState(const OptoSnapshot &seen) - Displays a graphic showing which optosensors are detecting a line.
+ * float linePosition(const OptoSnapshot &seen) - Where the line is under the sensors, continuous, from all three.
+ * void follow(double time, float speed) - Follows a line for a desired amount of time, PD steering on linePosition().
+ * void startFollow(double time, float speed) - Same as follow, but returns right away and runs on the scheduler.
+ *
+ * The sensors are read once per control tick through optos (see optoArray.h), and everything in here works off
+ * that one snapshot.
  */
-class LineFollowing
+class LineFollowing : public Task
 {
 public:
+    // Steering gains, can be changed between follows.
+    float kP, kD;
+
+    LineFollowing()
+    {
+        control = true;
+        kP = LINE_KP;
+        kD = LINE_KD;
+        lastSeen = 0.0;
+        optos.setLevels(OPTO_LEFT, LEFT_OPTO_OFF, LEFT_OPTO_ON);
+        optos.setLevels(OPTO_MID, MID_OPTO_OFF, MID_OPTO_ON);
+        optos.setLevels(OPTO_RIGHT, RIGHT_OPTO_OFF, RIGHT_OPTO_ON);
+        // Drawn left to right the same way round as before: right sensor's box on the left.
+        optoBox[OPTO_RIGHT] = display.addBox(PAGE_LINE, 75, 25, 50, 100);
+        optoBox[OPTO_MID] = display.addBox(PAGE_LINE, 125, 25, 50, 100);
+        optoBox[OPTO_LEFT] = display.addBox(PAGE_LINE, 175, 25, 50, 100);
+        timingRow = display.addText(PAGE_LINE, 8);
+    }
+
+    /**
+     * @brief Where the line is under the optosensors. Each voltage is scaled to 0 (off the line) to 1 (right over it)
+     * and the position is the weighted average of where the sensors are, so it moves smoothly as the line slides
+     * from one sensor to the next instead of jumping between four states.
+     *
+     * @param seen Snapshot of the sensors to work it out from.
+     * @return Line position in sensor spacings, 0 under the middle sensor, positive to the left. If no sensor sees
+     *      the line, LINE_LOST_POSITION on the side it was last seen.
+     */
+    float linePosition(const OptoSnapshot &seen)
+    {
+        float left = seen.weight[OPTO_LEFT];
+        float mid = seen.weight[OPTO_MID];
+        float right = seen.weight[OPTO_RIGHT];
+        float total = left + mid + right;
+        if (total < LINE_MIN_SIGNAL)
+        {
+            return lastSeen >= 0.0 ? LINE_LOST_POSITION : -LINE_LOST_POSITION;
+        }
+        float position = (left - right) / total;
+        if (position != 0.0)
+        {
+            lastSeen = position;
+        }
+        return position;
+    }
+
     /**
      *  getSensorState()
         @brief returns integer corresponding to line detection state: Middle: 1 Right: 2 Left: 3 None: 0
 
     **/
-    int getSensorState()
+    int getSensorState(const OptoSnapshot &seen)
     {
 
         // Check mid optosensor first because mid must be on line.
-        if (midOpto.Value() >= 1.1)
+        if (seen.onLine[OPTO_MID])
         {
             return 1;
         }
         // Nested if tree instead of else if because of GUI capability.
-        else if (rightOpto.Value() >= 1.8)
+        else if (seen.onLine[OPTO_RIGHT])
         {
             return 2;
         }
-        else if (leftOpto.Value() >= 1.8)
+        else if (seen.onLine[OPTO_LEFT])
         {
             return 3;
         }
@@ -697,298 +1116,292 @@ public:
         double start = TimeNow();
         while (TimeNow() - start <= desiredTime)
         {
-            // lineFollow.displayOptoState();
+            // lineFollow.displayOptoState(seen);
+            const OptoSnapshot &seen = optos.sample();
             LCD.Clear();
             LCD.WriteLine("LEFT OPTO VALUE");
-            LCD.WriteLine(leftOpto.Value());
+            LCD.WriteLine(seen.volts[OPTO_LEFT]);
             LCD.WriteLine("MID OPTO VALUE");
-            LCD.WriteLine(midOpto.Value());
+            LCD.WriteLine(seen.volts[OPTO_MID]);
             LCD.WriteLine("RIGHT OPTO VALUE");
-            LCD.WriteLine(rightOpto.Value());
+            LCD.WriteLine(seen.volts[OPTO_RIGHT]);
             Sleep(2.5);
             // On Line(LTR): 2.2-2.5 1.3(mid) 2.5+ right
             // Off Line(LTR); .178 .199 .232
         }
     }
     /**
-     * @brief Displays a graphic showing which optosensors are currently detecting a line.
+     * @brief Shows which optosensors are detecting a line in a snapshot, as coloured boxes on the line page. Only
+     * changes the widgets, the display draws them when it gets a chance.
      *
      */
-    void displayOptoState()
+    void displayOptoState(const OptoSnapshot &seen)
     {
-        bool midOnLine = false, rightOnLine = false, leftOnLine = false;
-        if (midOpto.Value() >= 1.1)
-        {
-            midOnLine = true;
-        }
-        // Nested if tree instead of else if because of GUI capability.
-        if (rightOpto.Value() >= 1.8)
-        {
-            rightOnLine = true;
-        }
-        if (leftOpto.Value() >= 1.8)
+        display.setColor(optoBox[OPTO_RIGHT], seen.onLine[OPTO_RIGHT] ? RED : GRAY);
+        display.setColor(optoBox[OPTO_MID], seen.onLine[OPTO_MID] ? GREEN : GRAY);
+        display.setColor(optoBox[OPTO_LEFT], seen.onLine[OPTO_LEFT] ? BLUE : GRAY);
+    }
+    /**
+     * @brief Follows a line for set ammount of time. Blocks until done, but other tasks keep running meanwhile.
+     *
+     * @param time Path corresponding to global path variable. Determines time for which to follow path.
+     * @param speed Optional. Base speed, times the equilibrium percentages.
+     */
+    void follow(double time, float speed = LINE_FOLLOW_SPEED)
+    {
+        startFollow(time, speed);
+        scheduler.waitFor(this);
+    }
+
+    /**
+     * @brief Starts following a line and returns right away. Following runs as a task on the scheduler.
+     *
+     * @param time Determines time for which to follow path.
+     * @param speed Optional. Base speed, times the equilibrium percentages.
+     */
+    void startFollow(double time, float speed = LINE_FOLLOW_SPEED)
+    {
+        followingTime = time;
+        baseSpeed = speed;
+        sTime = TimeNow();
+        firstTick = true;
+        // Nothing from the last follow carries over: filter, hysteresis, or which side the line was last seen on.
+        optos.restart();
+        lastSeen = 0.0;
+        display.showPage(PAGE_LINE);
+        loopTimer.start();
+        if (!scheduler.start(this))
         {
-            leftOnLine = true;
+            stopDrive();
+            runLog.add(LOG_SCHEDULER_FULL, LOG_PRIMITIVE_FOLLOW);
+            return;
         }
-        /*
-            Display GUI for sensors currently on line.
-        */
-        LCD.Clear();
-        LCD.SetBackgroundColor(GRAY);
-        if (rightOnLine)
+        telemetry.beginSegment(LOG_PRIMITIVE_FOLLOW);
+    }
+
+    /**
+     * @brief One pass of the line following loop. Called by the scheduler.
+     *
+     * @return true once the following time is up
+     */
+    bool step()
+    {
+        if (TimeNow() - sTime > followingTime)
         {
-            // This means that the left optisensor is on the line. Add this info to the GUI
-            LCD.SetFontColor(RED);
-            LCD.FillRectangle(75, 25, 50, 100);
+            return true;
         }
-        if (midOnLine)
+        // Control loop runs at a fixed rate, in between the scheduler gets on with other tasks.
+        if (!loopTimer.due())
         {
-            // Do the same for middle
-            LCD.SetFontColor(GREEN);
-            LCD.FillRectangle(125, 25, 50, 100);
+            return false;
         }
-        if (leftOnLine)
+        unsigned long now = MicrosNow();
+        // One read of the sensors per tick, steering and the GUI both go off it.
+        const OptoSnapshot &seen = optos.sample();
+        float position = linePosition(seen);
+        // Derivative on the position itself, nothing to difference against on the first tick.
+        float rate = 0.0;
+        if (!firstTick)
         {
-            // Do the same for right
-            LCD.SetFontColor(BLUE);
-            LCD.FillRectangle(175, 25, 50, 100);
+            rate = (position - lastPosition) / ((now - lastMicros) / 1000000.0);
         }
+        firstTick = false;
+        lastPosition = position;
+        lastMicros = now;
+        // Positive steer turns left: the left wheel slows down and the right one speeds up by as much.
+        float steer = kP * position + kD * rate;
+        steer = fmax(-LINE_MAX_STEER, fmin(LINE_MAX_STEER, steer));
+        setDrive(baseSpeed * (1.0 - steer) * LEFTPERCENT, baseSpeed * (1.0 + steer) * RIGHTPERCENT);
+        // Gui of which optosensors robot thinks are over the line. Cheap, the display only redraws what changed.
+        displayOptoState(seen);
+        loopTimer.done();
+        return false;
     }
+
     /**
-     * @brief Follows a line for set ammount of time.
-     *
-     * @param time Path corresponding to global path variable. Determines time for which to follow path.
+     * @brief Stops the motors once following is done and reports loop timing.
      */
-    void follow(double time)
+    void end()
     {
-
-        int state;
-        double sTime, followingTime = time, guiLoopTime = TimeNow();
-        sTime = TimeNow();
-        int lastState = 1;
-
-        while (TimeNow() - sTime <= followingTime)
-        {
-
-            state = getSensorState();
-            if (state != 0)
-            {
-                lastState = state;
-            }
-            else if (state == 0)
-            {
-                state = lastState;
-            }
-            // Display gui of which optosensors robot thinks are over the line.
-            if (TimeNow() - guiLoopTime >= 0.5)
-            {
-                displayOptoState();
-                guiLoopTime = TimeNow();
-            }
-            switch (state)
-            {
-            case (1):
-                // Middle sensor is on the line. Want to drive forward in this case
-                leftMotor.SetPercent(LEFTPERCENT);
-                rightMotor.SetPercent(RIGHTPERCENT);
-                break;
-            case (2):
-                // Right sensor is on the line! Correct by driving Right.
-                leftMotor.SetPercent(LEFTPERCENT + 20.0);
-                rightMotor.SetPercent(RIGHTPERCENT + 20.0);
-                break;
-            case (3):
-                // Left sensor is on the line! Correct by driving left
-                leftMotor.SetPercent(LEFTPERCENT - 20.0);
-                rightMotor.SetPercent(RIGHTPERCENT - 20.0);
-                break;
-            case (0):
-                // No sensors are on the line. WTF?? Do a circle i guess.
-                leftMotor.SetPercent(LEFTPERCENT);
-                rightMotor.SetPercent(-RIGHTPERCENT);
-            }
-        }
-        rightMotor.Stop();
-        leftMotor.Stop();
+        stopDrive();
+        telemetry.endSegment();
+        loopTimer.log(runLog, LOG_PRIMITIVE_FOLLOW);
+        char line[48];
+        loopTimer.summary(line);
+        display.setText(timingRow, line);
     }
+
+private:
+    // Following state kept between passes of the loop.
+    double sTime, followingTime;
+    float baseSpeed, lastPosition, lastSeen;
+    unsigned long lastMicros;
+    bool firstTick;
+
+    // Fixed rate tick and timing stats for the control loop
+    LoopTimer loopTimer;
+    // LCD boxes for the three sensors and the row for the loop timing.
+    int optoBox[NUM_OPTOS], timingRow;
 };
 /**
- * @brief Stores the RPS X and Y coordinates of waypoints
+ * @brief Stores the RPS X and Y coordinates of waypoints, see WaypointTable. Loads the course's waypoint file if
+ * there is one.
  *
  * The following functions are included in the Waypoint class:
- * void logCoordinates() - Allows the user to manually log essential coordinates right before a run
+ * void logCoordinates() - Loads this region's cached waypoints, or captures them with RPS right before a run
  */
-class Waypoints
+class Waypoints : public WaypointTable
 {
 public:
-    float jBoxLEDX, jBoxLEDY;
-    float trashX, trashY;
-    float redButtonX, redButtonY;
-    float blueButtonX, blueButtonY;
-    float rampBottomX, rampBottomY;
-    float rampTopX, rampTopY;
-    float grillX, grillY;
-    float topRightWallX;
-    float topCenterX, topCenterY;
-
-    // Heading is 135 degrees for levers
-    float vanillaLeverX, vanillaLeverY;
-    float twistLeverX, twistLeverY;
-    float chocolateLeverX, chocolateLeverY;
-    float ticketSliderX, ticketSliderY;
-    float bottomWallX, bottomWallY;
-    float vanillaActualX, vanillaActualY;
-    float twistActualX, twistActualY;
-    float chocolateActualX, chocolateActualY;
-    float stopButtonX, stopButtonY;
-    float bottomRightWallX, bottomRightWallY;
-
     Waypoints(int course)
     {
-       
-        // Initialize waypoints
-        jBoxLEDX = 8.2;
-        jBoxLEDY = 22.0;
-        trashX = 6.8;
-        trashY = 24.0;
-        redButtonX = 7.0;
-        redButtonY = 15.8;
-        blueButtonX = 9.3;
-        blueButtonY = 15.8;
-        rampBottomX = 15.4;
-        rampBottomY = 20.2;
-        rampTopX = 17.3;
-        rampTopY = 47.9;
-        topRightWallX = 28.6;
-        topCenterX = 27.4;
-        topCenterY = 45.7;
-        grillX = 30.8;
-        grillY = 61.4;
-        vanillaLeverX = 16.3;
-        vanillaLeverY = 50.4;
-        twistLeverX = 18.2;
-        twistLeverY = 52.5;
-        chocolateLeverX = 22.;
-        chocolateLeverY = 57.0;
-        ticketSliderX = 30.8;
-        ticketSliderY = 42.7;
-        bottomWallX = 28.7;
-        bottomWallY = 20.5;
-        vanillaActualX = 6.2;
-        vanillaActualY = 57.5;
-        twistActualX = 9.5;
-        twistActualY = 60.5;
-        chocolateActualX = 12.8;
-        chocolateActualY = 63.5;
-        stopButtonX = 28.7;
-        stopButtonY = 8.5;
+        load(course, RPS.CurrentRegionLetter());
     }
 
-    // Overrides the default coordinates if the team decides to log waypoints before a run.
+    /**
+     * @brief Gets this region's waypoints ready before a run.
+     *
+     * Points captured in this region before are cached in "<region>Self.txt" and loaded straight away; tap the left
+     * half of the screen to capture them again, anywhere else to keep them. Otherwise the operator puts the robot on
+     * each point and taps, and the point is averaged over several RPS frames (see capture()). The new set is saved
+     * over the cache.
+     */
     void logCoordinates()
     {
-        float x, y;
-        char fileName[11];
-        strcpy(fileName, (char *)RPS.CurrentRegionLetter());
-        strcat(fileName, "Self.txt");
+        float tapX, tapY;
+        char fileName[16];
+        sprintf(fileName, "%cSelf.txt", RPS.CurrentRegionLetter());
 
-        FEHFile *waypointlog = SD.FOpen(fileName, "w+");
-
-       
-
-        LCD.WriteLine("\n\n\n");
-        LCD.WriteLine("1) JUKEBOX LED");
-        Sleep(1.0);
-        LCD.ClearBuffer();
-        while (!LCD.Touch(&x, &y))
+        int cached = read(fileName, true);
+        if (cached > 0)
         {
+            LCD.Clear();
+            LCD.WriteLine("\n\n\n");
+            LCD.Write(cached);
+            LCD.WriteLine(" cached waypoints loaded.");
+            LCD.WriteLine("Tap left half to recapture.");
+            while (!LCD.Touch(&tapX, &tapY))
+            {
+            }
+            while (LCD.Touch(&tapX, &tapY))
+            {
+            }
+            LCD.Clear();
+            if (tapX >= 160)
+            {
+                return;
+            }
         }
-        while (LCD.Touch(&x, &y))
+
+        static const int captured[] = {WP_JUKEBOX_LED, WP_RED_BUTTON, WP_BLUE_BUTTON, WP_BOTTOM_RIGHT_WALL,
+                                       WP_TICKET_SLIDER};
+        double captureStart = TimeNow();
+        capture(WP_JUKEBOX_LED, "1) JUKEBOX LED", WHITE);
+        capture(WP_RED_BUTTON, "4) RED BUTTON", RED);
+        capture(WP_BLUE_BUTTON, "5) BLUE BUTTON", BLUE);
+        capture(WP_BOTTOM_RIGHT_WALL, "13) BOTTOM RIGHT WALL", WHITE);
+        capture(WP_TICKET_SLIDER, "14) TICKET SLIDER", WHITE);
+        LCD.SetFontColor(WHITE);
+        if (!save(fileName, captured, sizeof(captured) / sizeof(captured[0])))
         {
+            LCD.WriteLine("Could not save waypoints.");
         }
-        jBoxLEDX = RPS.X();
-        jBoxLEDY = RPS.Y();
-        LCD.WriteLine("Coordinate Logged.");
-        LCD.Clear();
+        LCD.Write("All Coordinates Logged in ");
+        LCD.Write((float)(TimeNow() - captureStart));
+        LCD.WriteLine(" s.");
+    }
 
-        LCD.SetFontColor(RED);
+private:
+    /**
+     * @brief Waits for a tap with the robot on a waypoint, then sets the waypoint to the average of the next
+     * WAYPOINT_FRAMES RPS fixes.
+     *
+     * Frames from the first WAYPOINT_SETTLE seconds after the tap are skipped, RPS is still showing where the robot
+     * was being carried from then. Fixes further than WAYPOINT_OUTLIER from the median are dropped before averaging.
+     * Gives up collecting after WAYPOINT_CAPTURE_TIMEOUT and goes with what it has. With no fixes at all the
+     * waypoint keeps what it was.
+     */
+    void capture(int id, const char *prompt, unsigned int color)
+    {
+        float tapX, tapY;
+        LCD.SetFontColor(color);
         LCD.WriteLine("\n\n\n");
-        LCD.WriteLine("4) RED BUTTON");
-        Sleep(1.0);
+        LCD.WriteLine(prompt);
         LCD.ClearBuffer();
-        while (!LCD.Touch(&x, &y))
+        while (!LCD.Touch(&tapX, &tapY))
         {
         }
-        while (LCD.Touch(&x, &y))
+        while (LCD.Touch(&tapX, &tapY))
         {
         }
-        redButtonX = RPS.X();
-        redButtonY = RPS.Y();
-        LCD.WriteLine("Coordinate Logged.");
-        LCD.Clear();
 
-        LCD.SetFontColor(BLUE);
-        LCD.WriteLine("\n\n\n");
-        LCD.WriteLine("5) BLUE BUTTON");
-        Sleep(1.0);
-        LCD.ClearBuffer();
-        while (!LCD.Touch(&x, &y))
+        float frameX[WAYPOINT_FRAMES], frameY[WAYPOINT_FRAMES];
+        int count = 0;
+        double released = TimeNow();
+        while (count < WAYPOINT_FRAMES && TimeNow() - released < WAYPOINT_CAPTURE_TIMEOUT)
         {
+            if (rps.update() && rps.sample.state == RPS_FIX && TimeNow() - released >= WAYPOINT_SETTLE)
+            {
+                frameX[count] = rps.sample.x;
+                frameY[count] = rps.sample.y;
+                count++;
+            }
         }
-        while (LCD.Touch(&x, &y))
+        if (count == 0)
         {
+            LCD.WriteLine("No RPS, kept the old one.");
+            scheduler.sleep(WAYPOINT_MESSAGE_TIME);
+            LCD.Clear();
+            return;
         }
-        blueButtonX = RPS.X();
-        blueButtonY = RPS.Y();
-        LCD.WriteLine("Coordinate Logged.");
-        LCD.Clear();
 
-        LCD.SetFontColor(WHITE);
-   
-        LCD.WriteLine("\n\n\n");
-        LCD.WriteLine("13) BOTTOM RIGHT WALL");
-        Sleep(1.0);
-        LCD.ClearBuffer();
-        while (!LCD.Touch(&x, &y))
+        float middleX = median(frameX, count), middleY = median(frameY, count);
+        float sumX = 0.0, sumY = 0.0;
+        int used = 0;
+        for (int i = 0; i < count; i++)
         {
+            if (hypot(frameX[i] - middleX, frameY[i] - middleY) <= WAYPOINT_OUTLIER)
+            {
+                sumX += frameX[i];
+                sumY += frameY[i];
+                used++;
+            }
         }
-        while (LCD.Touch(&x, &y))
+        // The median itself is always within range, so used is at least 1 for an odd count. For an even count the
+        // two middle frames can still be too far apart, then the median is the best there is.
+        if (used == 0)
         {
+            set(id, middleX, middleY);
         }
-        bottomRightWallX = RPS.X();
-        bottomRightWallY = RPS.Y();
-        LCD.WriteLine("Coordinate Logged.");
-        LCD.Clear();
-
-        LCD.WriteLine("\n\n\n");
-        LCD.WriteLine("14) TICKET SLIDER");
-        Sleep(1.0);
-        LCD.ClearBuffer();
-        while (!LCD.Touch(&x, &y))
+        else
         {
+            set(id, sumX / used, sumY / used);
         }
-        while (LCD.Touch(&x, &y))
+        LCD.Write("Coordinate Logged from ");
+        LCD.Write(used);
+        LCD.Write("/");
+        LCD.WriteLine(count);
+        scheduler.sleep(WAYPOINT_MESSAGE_TIME);
+        LCD.Clear();
+    }
+
+    /**
+     * @brief Median of some values. Sorts a copy, the values are left alone.
+     */
+    static float median(const float *values, int count)
+    {
+        float sorted[WAYPOINT_FRAMES];
+        for (int i = 0; i < count; i++)
         {
+            int j = i;
+            while (j > 0 && sorted[j - 1] > values[i])
+            {
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = values[i];
         }
-        ticketSliderX = RPS.X();
-        ticketSliderY = RPS.Y();
-        LCD.WriteLine("Coordinate Logged.");
-        LCD.Clear();
-        SD.FPrintf(waypointlog, "0. JukeBox LED from the start button: %f,%f\n", jBoxLEDX, jBoxLEDY);
-        SD.FPrintf(waypointlog, "1. Red Button: %f,%f\n", redButtonX, redButtonY);
-        SD.FPrintf(waypointlog, "2. Blue Button: %f,%f\n", blueButtonX, blueButtonY);
-        SD.FPrintf(waypointlog, "3. Ramp Top: %f,%f\n", rampTopX, rampTopY);
-        SD.FPrintf(waypointlog, "4. Twist Lever: %f,%f\n", twistLeverX, twistLeverY);
-        SD.FPrintf(waypointlog, "5. Bottom Right Wall: %f,%f\n", bottomRightWallX, bottomRightWallY);
-        SD.FPrintf(waypointlog, "6. Ticket Slider: %f,%f\n", ticketSliderX, ticketSliderY);
-        SD.FPrintf(waypointlog, "7. Stop Button: %f,%f", stopButtonX, stopButtonY);
-
-        SD.FClose(waypointlog);
-        LCD.WriteLine("All Coordinates Logged.");
-        Sleep(1.0);
-
-        
-    
+        return count % 2 == 1 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0;
     }
 };
 
@@ -1006,29 +1419,315 @@ public:
  * debugRight()
  */
 
+// LCD widgets for getLightColor(): the CdS voltage and a circle in the colour it reads as.
+int cdsRow = display.addText(PAGE_LIGHT, 0);
+int lightCircle = display.addCircle(PAGE_LIGHT, 160, 120, 60);
+
 /**
- * @brief Uses the CDS sensor to get the light color.
+ * @brief Uses the CDS sensor to get the light color, see CdsClassifier. Start jukeboxReader before driving up to
+ * the light and this hardly has to wait. Logs the reading and shows it on the light page.
  *
- * @return Light Color is Red: 1   Light Color is not red: 0
+ * @return The reading, color is CDS_RED, CDS_BLUE or CDS_NONE
  */
-int getLightColor()
+CdsReading getLightColor()
 {
-    LCD.Clear();
-    LCD.SetBackgroundColor(GRAY);
-    float cdsValue = cdsSensor.Value();
-    LCD.WriteLine(cdsValue);
-    if (cdsValue >= 0.0 && cdsValue <= 1.3)
+    CdsReading reading = jukeboxReader.classify();
+    runLog.add(LOG_JUKEBOX, reading.color, reading.volts, reading.confidence, reading.spread, reading.waited);
+    char line[32];
+    sprintf(line, "%.3f V %.0f%% SURE", reading.volts, 100.0 * reading.confidence);
+    display.showPage(PAGE_LIGHT);
+    display.setText(cdsRow, line);
+    if (reading.color == CDS_RED)
     { // Red
-        LCD.SetFontColor(RED);
-        LCD.FillCircle(160, 120, 60);
-        return 1;
+        display.setColor(lightCircle, RED);
     }
     else
-    { // Blue
-        LCD.SetFontColor(BLUE);
-        LCD.FillCircle(160, 120, 60);
-        return 0;
+    { // Blue, or gray for no light
+        display.setColor(lightCircle, reading.color == CDS_BLUE ? BLUE : GRAY);
+    }
+    return reading;
+}
+
+// Row above the status row on every page, for the mission step running.
+int missionRow = display.addText(DISPLAY_ALL_PAGES, 12);
+
+/**
+ * @brief Carries out mission steps on this robot, see mission.h. The table is competitionRun below.
+ *
+ * Travels worked if the robot ended up within MISSION_ARRIVE_TOLERANCE of the point, faces if it's pointing within
+ * MISSION_FACE_TOLERANCE of it, drives and turns if the wheels didn't stall. Pushes are meant to stall against
+ * something, so they always work, and so do servo moves and line following (nothing to check them against).
+ */
+class CourseRun : public Mission
+{
+public:
+    CourseRun(Motion &chassis, LineFollowing &follower, Waypoints &table) : Mission(table, ::scheduler, ::runLog)
+    {
+        motion = &chassis;
+        lineFollow = &follower;
+    }
+
+    bool perform(const MissionStep &step)
+    {
+        char line[32];
+        sprintf(line, "STEP %d %s", current, missionTaskName(step.task));
+        display.setText(missionRow, line);
+        float x = pointX(step, odometry.x), y = pointY(step, odometry.y);
+        switch (step.op)
+        {
+        case STEP_VIA:
+            return addVia(x, y);
+        case STEP_TRAVEL:
+            if (vias > 0)
+            {
+                addVia(x, y);
+                motion->followPath(viaX, viaY, vias);
+            }
+            else
+            {
+                motion->travelTo(x, y);
+            }
+            return !motion->stalled && odometry.distanceTo(x, y) <= MISSION_ARRIVE_TOLERANCE;
+        case STEP_ROUTE:
+        {
+            int route = findRoute(current);
+            if (route >= 0)
+            {
+                motion->followPath(routeX[route], routeY[route], routePoints[route]);
+            }
+            else
+            {
+                motion->travelTo(x, y);
+            }
+            return !motion->stalled && odometry.distanceTo(x, y) <= MISSION_ARRIVE_TOLERANCE;
+        }
+        case STEP_FACE:
+        {
+            // Judged against the heading it set out to face, a point an inch away moves a lot as the robot turns.
+            float heading = odometry.bearingTo(x, y);
+            bool there = odometry.distanceTo(x, y) < 0.1;
+            motion->travelTo(x, y, false);
+            return there || fabs(Odometry::angleDifference(heading, odometry.heading)) <= MISSION_FACE_TOLERANCE;
+        }
+        case STEP_TURN:
+            motion->turn(fabs(step.a), step.a > 0.0 ? LEFT : RIGHT);
+            return !motion->stalled;
+        case STEP_FORWARD:
+            motion->driveForward(step.a, true);
+            return !motion->stalled;
+        case STEP_PUSH:
+            motion->driveForward(step.a, false);
+            return true;
+        case STEP_BACK:
+            motion->driveBackwards(step.a);
+            return !motion->stalled;
+        case STEP_SERVO:
+        {
+            ServoMove *servos[] = {&trayMove, &burgerMove, &ticketMove};
+            servos[step.arg]->moveTo(step.a, step.b);
+            if (step.arg2)
+            {
+                ::scheduler.waitFor(servos[step.arg]);
+            }
+            return true;
+        }
+        case STEP_FOLLOW:
+            lineFollow->follow(step.a);
+            return true;
+        case STEP_LISTEN:
+            jukeboxReader.start();
+            return true;
+        case STEP_READ_COLOR:
+        {
+            CdsReading reading = getLightColor();
+            color = reading.color;
+            return color != CDS_NONE && reading.confidence >= MISSION_COLOR_CONFIDENCE;
+        }
+        default:
+            return false;
+        }
+    }
+
+private:
+    Motion *motion;
+    LineFollowing *lineFollow;
+};
+
+/*
+    The competition run, one step per line, see MissionStep for what the numbers mean. Budgets are a couple of times
+    what the step takes in the simulator, so they only cut in when something is actually stuck. Getting to a task
+    gets a retry and skips the task if it still can't; the fiddly bits in between just carry on.
+*/
+const MissionStep competitionRun[] = {
+    // task, op, when, arg, arg2, a, b, budget, retries, onFail
+    // Line up 10 in out from the jukebox light and run straight in. CdS sampling starts on the way in, so the
+    // colour is ready about as soon as the robot stops.
+    {TASK_JUKEBOX, STEP_LISTEN, WHEN_ALWAYS, 0, 0, 0.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_JUKEBOX, STEP_VIA, WHEN_ALWAYS, WP_JUKEBOX_LED, WP_JUKEBOX_LED, 10.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_JUKEBOX, STEP_TRAVEL, WHEN_ALWAYS, WP_JUKEBOX_LED, WP_JUKEBOX_LED, 1.5, 0.0, 10.0, 1, FAIL_NEXT},
+    {TASK_JUKEBOX, STEP_READ_COLOR, WHEN_ALWAYS, 0, 0, 0.0, 0.0, 2.0, 1, FAIL_NEXT},
+    // Align with and follow the line to the trashcan, back off and dump the tray.
+    {TASK_TRAY, STEP_FACE, WHEN_ALWAYS, WP_TRASH, WP_TRASH, 0.0, 0.0, 4.0, 1, FAIL_SKIP_TASK},
+    {TASK_TRAY, STEP_FOLLOW, WHEN_ALWAYS, 0, 0, Time_Tray, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_TRAY, STEP_BACK, WHEN_ALWAYS, 0, 0, 0.75, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_TRAY, STEP_WAIT, WHEN_ALWAYS, 0, 0, 0.5, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_TRAY, STEP_TURN, WHEN_ALWAYS, 0, 0, -8.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_TRAY, STEP_SERVO, WHEN_ALWAYS, MISSION_TRAY, 1, 95.0, TRAY_DUMP_HOLD, 2.0, 0, FAIL_NEXT},
+    // Tray swings back down while backing away
+    {TASK_TRAY, STEP_SERVO, WHEN_ALWAYS, MISSION_TRAY, 0, 0.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_TRAY, STEP_BACK, WHEN_ALWAYS, 0, 0, 2.0, 0.0, 4.0, 0, FAIL_NEXT},
+    {TASK_TRAY, STEP_FACE, WHEN_ALWAYS, MISSION_HERE, MISSION_HERE, 0.0, -1.0, 4.0, 0, FAIL_NEXT},
+    {TASK_TRAY, STEP_FORWARD, WHEN_ALWAYS, 0, 0, 3.0, 0.0, 4.0, 0, FAIL_NEXT},
+    // Jukebox button for the colour read
+    {TASK_BUTTON, STEP_ROUTE, WHEN_RED, WP_RED_BUTTON, WP_RED_BUTTON, 0.0, 0.0, 8.0, 1, FAIL_SKIP_TASK},
+    {TASK_BUTTON, STEP_ROUTE, WHEN_BLUE, WP_BLUE_BUTTON, WP_BLUE_BUTTON, 0.0, 0.0, 8.0, 1, FAIL_SKIP_TASK},
+    {TASK_BUTTON, STEP_BACK, WHEN_ALWAYS, 0, 0, 1.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_BUTTON, STEP_FACE, WHEN_ALWAYS, MISSION_HERE, MISSION_HERE, 0.0, -1.0, 4.0, 0, FAIL_NEXT},
+    {TASK_BUTTON, STEP_PUSH, WHEN_ALWAYS, 0, 0, 2.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_BUTTON, STEP_BACK, WHEN_ALWAYS, 0, 0, 4.0, 0.0, 4.0, 0, FAIL_NEXT},
+    // Up the ramp. The ramp's the only way through on the course map, so the route comes in lined up with it. If it
+    // doesn't get up, everything up top is skipped (see courseTasks).
+    {TASK_UP_RAMP, STEP_ROUTE, WHEN_ALWAYS, WP_RAMP_TOP, WP_RAMP_TOP, 0.0, 0.0, 12.0, 1, FAIL_SKIP_TASK},
+    // Burger, straight off the top of the ramp
+    {TASK_BURGER, STEP_SERVO, WHEN_ALWAYS, MISSION_BURGER, 0, 100.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_TURN, WHEN_ALWAYS, 0, 0, -60.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_WAIT, WHEN_ALWAYS, 0, 0, 0.3, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_TRAVEL, WHEN_ALWAYS, WP_GRILL_LANE, MISSION_HERE, 0.0, 0.5, 8.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_TURN, WHEN_ALWAYS, 0, 0, 70.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_SERVO, WHEN_ALWAYS, MISSION_BURGER, 0, 0.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_TRAVEL, WHEN_ALWAYS, WP_GRILL, WP_GRILL, 0.0, 0.0, 8.0, 1, FAIL_SKIP_TASK},
+    {TASK_BURGER, STEP_BACK, WHEN_ALWAYS, 0, 0, 0.5, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_TURN, WHEN_ALWAYS, 0, 0, -15.0, 0.0, 3.0, 0, FAIL_NEXT},
+    // Flip the grill up
+    {TASK_BURGER, STEP_SERVO, WHEN_ALWAYS, MISSION_BURGER, 1, 110.0, BURGER_FLIP_HOLD, 2.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_SERVO, WHEN_ALWAYS, MISSION_BURGER, 0, 0.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_BACK, WHEN_ALWAYS, 0, 0, 1.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_SERVO, WHEN_ALWAYS, MISSION_TICKET, 0, 130.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_TURN, WHEN_ALWAYS, 0, 0, 90.0, 0.0, 4.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_WAIT, WHEN_ALWAYS, 0, 0, 0.5, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_TURN, WHEN_ALWAYS, 0, 0, -90.0, 0.0, 4.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_BACK, WHEN_ALWAYS, 0, 0, 4.0, 0.0, 4.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_SERVO, WHEN_ALWAYS, MISSION_TICKET, 0, 170.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_SERVO, WHEN_ALWAYS, MISSION_BURGER, 0, 110.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_BURGER, STEP_FACE, WHEN_ALWAYS, MISSION_HERE, MISSION_HERE, -1.0, 0.0, 4.0, 0, FAIL_NEXT},
+    // Ice cream lever for the flavor RPS handed out
+    {TASK_LEVER, STEP_FACE, WHEN_VANILLA, WP_VANILLA_ACTUAL, WP_VANILLA_ACTUAL, 0.0, 0.0, 4.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_ROUTE, WHEN_VANILLA, WP_VANILLA_LEVER, WP_VANILLA_LEVER, 0.0, 0.0, 8.0, 1, FAIL_SKIP_TASK},
+    {TASK_LEVER, STEP_ROUTE, WHEN_TWIST, WP_TWIST_LEVER, WP_TWIST_LEVER, 0.0, 0.0, 8.0, 1, FAIL_SKIP_TASK},
+    {TASK_LEVER, STEP_ROUTE, WHEN_CHOCOLATE, WP_CHOCOLATE_LEVER, WP_CHOCOLATE_LEVER, 0.0, 0.0, 8.0, 1, FAIL_SKIP_TASK},
+    {TASK_LEVER, STEP_FACE, WHEN_CHOCOLATE, WP_CHOCOLATE_ACTUAL, WP_CHOCOLATE_ACTUAL, 0.0, 0.0, 4.0, 0, FAIL_NEXT},
+    // At the lever, face 135 degrees and push it down, then wait out the ice cream and push it back up.
+    {TASK_LEVER, STEP_FACE, WHEN_ALWAYS, MISSION_HERE, MISSION_HERE, -1.0, 1.0, 4.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_WAIT, WHEN_ALWAYS, 0, 0, 0.5, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_FORWARD, WHEN_ALWAYS, 0, 0, 7.0, 0.0, 5.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_WAIT, WHEN_ALWAYS, 0, 0, 0.3, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_MARK, WHEN_ALWAYS, 0, 0, 0.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_SERVO, WHEN_ALWAYS, MISSION_TRAY, 1, 90.0, LEVER_HOLD, 2.0, 0, FAIL_NEXT},
+    // Lower the tray while backing off the lever
+    {TASK_LEVER, STEP_SERVO, WHEN_ALWAYS, MISSION_TRAY, 0, 20.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_BACK, WHEN_ALWAYS, 0, 0, 4.0, 0.0, 4.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_SERVO, WHEN_ALWAYS, MISSION_TRAY, 0, 130.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_WAIT_MARK, WHEN_ALWAYS, 0, 0, 8.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_PUSH, WHEN_ALWAYS, 0, 0, 4.0, 0.0, 4.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_SERVO, WHEN_ALWAYS, MISSION_TRAY, 1, 40.0, LEVER_HOLD, 2.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_SERVO, WHEN_ALWAYS, MISSION_TRAY, 0, 130.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_BACK, WHEN_ALWAYS, 0, 0, 9.0, 0.0, 6.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_TURN, WHEN_ALWAYS, 0, 0, -60.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_FORWARD, WHEN_ALWAYS, 0, 0, 4.0, 0.0, 4.0, 0, FAIL_NEXT},
+    {TASK_LEVER, STEP_SERVO, WHEN_ALWAYS, MISSION_TRAY, 0, 0.0, 0.0, 0.0, 0, FAIL_NEXT},
+    // Down the ramp, same as up. The ticket carries on from the bottom, so it's skipped if this doesn't get there.
+    {TASK_DOWN_RAMP, STEP_ROUTE, WHEN_ALWAYS, WP_DOWN_RAMP_BOTTOM, WP_DOWN_RAMP_BOTTOM, 0.0, 0.0, 12.0, 1, FAIL_SKIP_TASK},
+    // Along the bottom right wall to the ticket slider
+    {TASK_TICKET, STEP_TURN, WHEN_ALWAYS, 0, 0, 60.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_TICKET, STEP_TRAVEL, WHEN_ALWAYS, WP_BOTTOM_RIGHT_WALL, MISSION_HERE, 0.0, -0.5, 8.0, 0, FAIL_NEXT},
+    {TASK_TICKET, STEP_TRAVEL, WHEN_ALWAYS, MISSION_HERE, MISSION_HERE, 0.0, 1.0, 4.0, 0, FAIL_NEXT},
+    {TASK_TICKET, STEP_SERVO, WHEN_ALWAYS, MISSION_TICKET, 0, 80.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_TICKET, STEP_TRAVEL, WHEN_ALWAYS, WP_TICKET_SLIDER, WP_TICKET_SLIDER, 0.0, 0.0, 8.0, 1, FAIL_SKIP_TASK},
+    {TASK_TICKET, STEP_TURN, WHEN_ALWAYS, 0, 0, 60.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_TICKET, STEP_WAIT, WHEN_ALWAYS, 0, 0, 2.0, 0.0, 0.0, 0, FAIL_NEXT},
+    {TASK_TICKET, STEP_TURN, WHEN_ALWAYS, 0, 0, -60.0, 0.0, 3.0, 0, FAIL_NEXT},
+    {TASK_TICKET, STEP_BACK, WHEN_ALWAYS, 0, 0, 5.0, 0.0, 4.0, 0, FAIL_NEXT},
+    // Ticket arm retracts during the travel, no need to wait for it.
+    {TASK_TICKET, STEP_SERVO, WHEN_ALWAYS, MISSION_TICKET, 0, 170.0, 0.0, 0.0, 0, FAIL_NEXT},
+    // Stop button, and run into it. It gets faced first since a plan can get here from anywhere.
+    {TASK_STOP, STEP_ROUTE, WHEN_ALWAYS, WP_STOP_BUTTON, WP_STOP_BUTTON, 0.0, 0.0, 10.0, 1, FAIL_NEXT},
+    {TASK_STOP, STEP_FACE, WHEN_ALWAYS, WP_STOP_BUTTON, WP_STOP_BUTTON, 0.0, -10.0, 3.0, 0, FAIL_NEXT},
+    {TASK_STOP, STEP_FORWARD, WHEN_ALWAYS, 0, 0, 5.0, 0.0, 4.0, 0, FAIL_NEXT},
+};
+
+/*
+    What the planner knows about each task, see planner.h. Points are what each task is worth to us, only the ratios
+    matter, so put the scoring sheet's numbers in. Chances are the task success rates from simMonteCarlo, seconds are
+    the work column of Simulation/taskTimes over simulated runs. Swap in numbers from real runs when there are some.
+    The ramps are all approach there, their one route step runs all the way to the far end, so theirs is the climb
+    from entry to exit that the planner's travel estimate doesn't cover.
+    The jukebox light is worth nothing by itself, it's there for the button. Follows and needs also tell the mission
+    what to skip when a task fails: everything on the upper level needs the up ramp, and the ticket carries on from
+    the bottom of the down ramp.
+*/
+const TaskModel courseTasks[] = {
+    // task, points, chance, seconds, entry, exit, level, endLevel, follows, needs, final
+    {TASK_JUKEBOX, 0.0, 1.0, 0.1, WP_JUKEBOX_LED, WP_JUKEBOX_LED, LEVEL_LOWER, LEVEL_LOWER, PLAN_NONE, PLAN_NONE, false},
+    {TASK_TRAY, 10.0, 1.0, 5.5, WP_JUKEBOX_LED, WP_TRASH, LEVEL_LOWER, LEVEL_LOWER, TASK_JUKEBOX, PLAN_NONE, false},
+    {TASK_BUTTON, 10.0, 0.94, 1.3, WP_BLUE_BUTTON, WP_BLUE_BUTTON, LEVEL_LOWER, LEVEL_LOWER, PLAN_NONE, TASK_JUKEBOX, false},
+    {TASK_UP_RAMP, 0.0, 1.0, 3.0, WP_RAMP_BOTTOM, WP_RAMP_TOP, LEVEL_LOWER, LEVEL_UPPER, PLAN_NONE, PLAN_NONE, false},
+    {TASK_BURGER, 15.0, 1.0, 10.4, WP_RAMP_TOP, WP_GRILL, LEVEL_UPPER, LEVEL_UPPER, TASK_UP_RAMP, PLAN_NONE, false},
+    {TASK_LEVER, 20.0, 0.97, 14.0, WP_TWIST_LEVER, WP_TWIST_LEVER, LEVEL_UPPER, LEVEL_UPPER, PLAN_NONE, TASK_UP_RAMP, false},
+    {TASK_DOWN_RAMP, 0.0, 1.0, 3.0, WP_DOWN_RAMP_TOP, WP_DOWN_RAMP_BOTTOM, LEVEL_UPPER, LEVEL_LOWER, PLAN_NONE, TASK_UP_RAMP, false},
+    {TASK_TICKET, 10.0, 1.0, 9.5, WP_DOWN_RAMP_BOTTOM, WP_TICKET_SLIDER, LEVEL_LOWER, LEVEL_LOWER, TASK_DOWN_RAMP, PLAN_NONE, false},
+    {TASK_STOP, 5.0, 1.0, 0.8, WP_STOP_BUTTON, WP_STOP_BUTTON, LEVEL_LOWER, LEVEL_LOWER, PLAN_NONE, PLAN_NONE, true},
+};
+
+/*
+    What's in the way on the course, in the same coordinates as the built in waypoints: the edges of the upper level
+    and the sides of the ramp (so the ramp is the only way between levels), the jukebox, the sink, the ice cream
+    machine and the grill. Rough outlines off the waypoints, the robot radius in courseMap.h gives the clearance.
+*/
+const MapObstacle courseObstacles[] = {
+    // x0, y0, x1, y1
+    {0.0, 44.0, 11.0, 44.5},  // upper level edge, left of the ramp
+    {23.0, 44.0, 36.0, 44.5}, // upper level edge, right of the ramp
+    {10.5, 24.0, 11.0, 44.0}, // ramp sides
+    {23.0, 24.0, 23.5, 44.0},
+    {3.0, 6.0, 13.0, 11.5},   // jukebox
+    {0.0, 26.0, 2.5, 34.0},   // sink
+    {0.0, 60.0, 8.0, 72.0},   // ice cream machine
+    {8.0, 64.0, 12.0, 72.0},
+    {0.0, 56.0, 4.0, 60.0},
+    {26.0, 65.0, 36.0, 72.0}, // grill
+};
+
+CourseMap courseMap;
+
+/**
+ * @brief Plans the run from (startX, startY) (see planner.h), logs the plan and puts its length and estimated time
+ * on the mission row.
+ *
+ * @param steps Filled with the planned mission, MAX_PLAN_STEPS long
+ * @return Steps in the plan. If nothing fits, the whole of competitionRun.
+ */
+int planRun(Waypoints &points, float startX, float startY, MissionStep *steps)
+{
+    MissionPlanner planner(courseTasks, sizeof(courseTasks) / sizeof(courseTasks[0]), points);
+    int count = sizeof(competitionRun) / sizeof(competitionRun[0]);
+    if (!planner.plan(startX, startY, PLAN_TIME_LIMIT))
+    {
+        display.setText(missionRow, "NO PLAN, RUNNING ALL");
+        for (int i = 0; i < count && i < MAX_PLAN_STEPS; i++)
+        {
+            steps[i] = competitionRun[i];
+        }
+        return count < MAX_PLAN_STEPS ? count : MAX_PLAN_STEPS;
     }
+    for (int i = 0; i < planner.length; i++)
+    {
+        runLog.add(LOG_PLAN, i, planner.order[i], planner.finishTime[i]);
+    }
+    runLog.add(LOG_PLAN, -1, planner.length, planner.expected, planner.seconds, planner.searched);
+    char line[32];
+    sprintf(line, "PLAN %d TASKS %.0fS", planner.length, planner.seconds);
+    display.setText(missionRow, line);
+    return planner.build(competitionRun, count, steps, MAX_PLAN_STEPS);
 }
 
 
@@ -1037,14 +1736,46 @@ int main(void)
 
     float x, y;
     double runStart;
-    int jukeBoxColor;
     LCD.WriteLine(Battery.Voltage());
     LineFollowing lineFollow;
     Motion motion(20);
 
-    FEHFile *rpsCoordLog = SD.FOpen("coords.txt", "a+");
-    FEHFile *rpsTravelLog = SD.FOpen("rpsTrav.txt", "a+");
-    FEHFile *data = SD.FOpen("data.txt", "w+");
+    // New log file every run, decode with Simulation/logDecode.
+    runLog.open();
+    telemetry.open(runLog.runNumber);
+    batteryMonitor.start();
+    display.start();
+    rps.lost = rpsLost;
+    // Motor equilibrium from the last calibration, if there is one. Otherwise the numbers at the top of the file.
+    MotorCalibration calibration;
+    if (calibration.load())
+    {
+        LEFTPERCENT = calibration.leftPercent;
+        RIGHTPERCENT = calibration.rightPercent;
+    }
+    LCD.WriteLine("Calibrate motors? Tap left half, right half to skip.");
+    while (!LCD.Touch(&x, &y))
+    {
+    }
+    float tapX = x;
+    while (LCD.Touch(&x, &y))
+    {
+    }
+    if (tapX < 160.0)
+    {
+        // Needs about 16 in of clear floor in front of the robot.
+        if (motion.calibrate(calibration))
+        {
+            calibration.save();
+        }
+        else
+        {
+            LCD.WriteLine("CALIBRATION FAILED, OLD VALUES KEPT");
+        }
+    }
+    LCD.WriteLine("LEFT/RIGHT PERCENT:");
+    LCD.WriteLine(LEFTPERCENT);
+    LCD.WriteLine(RIGHTPERCENT);
     //Servo calibration
     trayServo.SetMin(517);
     trayServo.SetMax(2500);
@@ -1055,17 +1786,24 @@ int main(void)
 
     
     // Set all servos to initial positions
-    burgerServo.SetDegree(100.0);
-    trayServo.SetDegree(0.0);
-    ticketServo.SetDegree(170.0);
+    burgerMove.set(100.0);
+    trayMove.set(0.0);
+    ticketMove.set(170.0);
     RPS.InitializeTouchMenu();
     int coursenum = RPS.CurrentCourse();
     Waypoints *points = new Waypoints(coursenum);
     points->logCoordinates();
-    trayServo.SetDegree(45.0);
-    // Get ice cream flavor from rps
+    trayMove.set(45.0);
+    // Get ice cream flavor from rps. Anything else than the three flavors means RPS didn't say, go for the middle
+    // lever, it's the closest to the other two.
     int flavor = RPS.GetIceCream();
-    SD.FPrintf(data, "Ice cream flavor: %d\n", flavor);
+    runLog.add(LOG_FLAVOR, flavor);
+    CourseRun course(motion, lineFollow, *points);
+    course.flavor = flavor >= 0 && flavor <= 2 ? flavor : 1;
+    for (unsigned int i = 0; i < sizeof(courseTasks) / sizeof(courseTasks[0]); i++)
+    {
+        course.dependsOn(courseTasks[i].task, courseTasks[i].follows, courseTasks[i].needs);
+    }
     LCD.WriteLine("Tap to continue.");
     while (!LCD.Touch(&x, &y))
     {
@@ -1084,213 +1822,45 @@ int main(void)
     while (LCD.Touch(&x, &y))
     {
     }
-    // Wait for run to begin.
-    float leftReset = LEFTPERCENT, rightReset = RIGHTPERCENT;
-
-    while (getLightColor() != 1)
-    {
-    }
+    // Plan the run, and the routes between its tasks, from where the robot is sitting. Without an RPS fix that's
+    // the stop button, the start is right next to it.
+    RpsSample start = rps.current();
+    float startX = start.state == RPS_FIX ? start.x : points->x(WP_STOP_BUTTON);
+    float startY = start.state == RPS_FIX ? start.y : points->y(WP_STOP_BUTTON);
+    float startHeading = start.state == RPS_FIX ? Odometry::fromRpsHeading(start.heading) : 90.0;
+    static MissionStep plannedRun[MAX_PLAN_STEPS];
+    int plannedSteps = planRun(*points, startX, startY, plannedRun);
+    courseMap.build(courseObstacles, sizeof(courseObstacles) / sizeof(courseObstacles[0]), points->offsetX,
+                    points->offsetY);
+    course.planRoutes(plannedRun, plannedSteps, courseMap, startX, startY, startHeading);
+    // Wait for run to begin. The menus wrote straight to the LCD, so the light page gets drawn from scratch. Nothing
+    // left in the log buffer, so the scheduler passes while waiting stay short.
+    runLog.flush();
+    display.invalidate();
+    display.showPage(PAGE_LIGHT);
+    display.setText(cdsRow, "WAITING FOR LIGHT");
+    display.setColor(lightCircle, GRAY);
+    startLight.wait();
+    display.setColor(lightCircle, RED);
     runStart = TimeNow();
+    jukeboxReader.setAmbient(startLight.baseline);
+    // Pose tracking runs in the background for the rest of the run.
+    scheduler.start(&odometry);
     // motion.driveForward(.5, true);
-    SD.FPrintf(data, "Run start: %f\n", runStart);
-    motion.travelTo(points->jBoxLEDX+10.0, points->jBoxLEDY, true);
-    motion.travelTo(points->jBoxLEDX+1.5, points->jBoxLEDY, true);
-    
-    Sleep(1.0);
-    jukeBoxColor=getLightColor();
-
-   
-    SD.FPrintf(data, "Jukebox color: %d\n", jukeBoxColor);
-    SD.FPrintf(data, "CDS voltage at jukebox: %f\n", cdsSensor.Value());
-    // Print found jukebox color, and volage found  to data file
-    
-    // Align with and travel to trashcan.
-    motion.travelTo(points->trashX, points->trashY, false);
-    lineFollow.follow(Time_Tray);
-    motion.driveBackwards(0.75);
-    // Dump the tray
-    
-    Sleep(0.5);
-    motion.turn(8.0,RIGHT);
-    trayServo.SetDegree(95.0);
-    Sleep(1.0);
-    trayServo.SetDegree(0.0);
-    motion.driveBackwards(2.0);
-    motion.travelTo(RPS.X(), RPS.Y() - 1., false);
-    
-    motion.driveForward(3.0,true);
-    
-    
-
-
-    
-    if (jukeBoxColor == 1)
+    runLog.add(LOG_RUN_START, 0, coursenum);
+    course.run(plannedRun, plannedSteps);
+    runLog.add(LOG_RUN_END, 0, TimeNow() - runStart);
+    runLog.add(LOG_RPS_STATS, 0, rps.frames, rps.updateRate, rps.tornReads, rps.dropouts);
+    runLog.add(LOG_TELEMETRY_STATS, 0, telemetry.segments, telemetry.samples, telemetry.dropped);
+    if (scheduler.overflows > 0)
     {
-        // motion.travelTo(points->redButtonX,points->redButtonY,false);
-        motion.travelTo(points->redButtonX, points->redButtonY);
-        LEFTPERCENT=leftReset;
-        RIGHTPERCENT=rightReset;
-        motion.driveBackwards(1.0);
-        motion.travelTo(RPS.X(), RPS.Y() - 1., false);
-        motion.driveForward(2.0,false);
-       
+        runLog.add(LOG_SCHEDULER_FULL, -1, scheduler.overflows);
     }
-    else
-    {
-        // motion.travelTo(points->blueButtonX,points->blueButtonY,false);
-        motion.travelTo(points->blueButtonX, points->blueButtonY);
-        LEFTPERCENT=leftReset;
-        RIGHTPERCENT=rightReset;
-        motion.driveBackwards(1.0);
-        motion.travelTo(RPS.X(), RPS.Y() - 1., false);
-        motion.driveForward(2.0,false);
-    }
-    LEFTPERCENT=leftReset;
-    RIGHTPERCENT=rightReset;
-    motion.driveBackwards(4.0);
-
-    /*
-    motion.travelTo(29.3,18.1);
-    motion.travelTo(28.,27.1);
-    motion.travelTo(RPS.X(),RPS.Y()+1.0,false);
-    motion.turn(75.0,RIGHT);
-    burgerServo.SetDegree(35.0);
-    Sleep(1.0);
-    motion.turn(90.0,LEFT);
-    motion.turn(135.,RIGHT);
-    */
-    burgerServo.SetDegree(100.0);
-    
-    // Ramp Base
-    motion.travelTo(points->rampBottomX, points->rampBottomY);
-    motion.travelTo(RPS.X(), RPS.Y() + 1, false);
-    // Top of ramp
-    motion.travelTo(points->rampTopX, points->rampTopY);
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-    motion.turn(60.0,RIGHT);
-    Sleep(0.3);
-    motion.travelTo(31.6, RPS.Y()+0.5);
-    motion.turn(70.0,LEFT);
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-    //Dont think this line is nescesary
-    //motion.travelTo(RPS.X() + 1, RPS.Y() + 5);
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-    burgerServo.SetDegree(0.0);
-    motion.travelTo(points->grillX, points->grillY);
-    motion.driveBackwards(0.5);
-    motion.turn(15.0, RIGHT);
-    //Flip the grill up
-    burgerServo.SetDegree(110.0);
-    Sleep(1.0);
-    
+    display.log();
 
-    burgerServo.SetDegree(0.0);
-    motion.driveBackwards(1.0);
-    ticketServo.SetDegree(130.0);
-    motion.turn(90, LEFT);
-    Sleep(0.5);
-    motion.turn(90, RIGHT);
-    motion.driveBackwards(4.0);
-    ticketServo.SetDegree(170.0);
-    burgerServo.SetDegree(110.0);
-
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-    //motion.travelTo(points->topCenterX, points->topCenterY);
-    
-    motion.travelTo(RPS.X()-1,RPS.Y(),false);
-
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-   
-
-    //motion.travelTo(RPS.X() - 1., RPS.Y() + 1., false);
-    burgerServo.SetDegree(110);
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-    flavor=1;
-    switch (flavor)
-    {
-    case 0:
-        motion.travelTo(points->vanillaActualX, points->vanillaActualY, false);
-        motion.travelTo(points->vanillaLeverX, points->vanillaLeverY);
-
-        break;
-    case 1:
-        // motion.travelTo(points->twistLeverX,points->twistLeverY,false);
-        //motion.travelTo(points->twistActualX, points->twistActualY, false);
-        motion.travelTo(points->twistLeverX, points->twistLeverY);
-        //motion.travelTo(points->twistActualX, points->twistActualY, false);
-        break;
-    case 2:
-
-        // motion.travelTo(points->chocolateLeverX,points->chocolateLeverY,false);
-
-        motion.travelTo(points->chocolateLeverX, points->chocolateLeverY);
-        motion.travelTo(points->chocolateActualX, points->chocolateActualY, false);
-    }
-    // At lever
-    // align to 135 degrees
-    motion.travelTo(RPS.X()-1,RPS.Y()+1,false);
-
-    Sleep(0.5);
-
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-    motion.driveForward(7.0,true);
-    Sleep(0.3);
-    trayServo.SetDegree(90.0);
-    double iceCreamStart = TimeNow();
-    Sleep(1.0);
-    trayServo.SetDegree(20.0);
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-    motion.driveBackwards(4.0);
-    trayServo.SetDegree(130.0);
-    while (TimeNow() - iceCreamStart <= 8.0)
-    {
-    }
-    motion.driveForward(4.0, false);
-    trayServo.SetDegree(40.0);
-    Sleep(1.0);
-    trayServo.SetDegree(130.0);
-    motion.driveBackwards(9.0);
-    motion.turn(60,RIGHT);
-    motion.driveForward(4.0,true);
-    trayServo.SetDegree(0.0);
-    motion.travelTo(17.6, 43.5);
-    motion.travelTo(18.3, 20.6);
-    motion.turn(60.0,LEFT);
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-    motion.travelTo(points->bottomRightWallX, RPS.Y()-0.5);
-    motion.travelTo(RPS.X(), RPS.Y() + 1.0);
-    ticketServo.SetDegree(80.0);
-    motion.travelTo(points->ticketSliderX, points->ticketSliderY);
-    motion.turn(60.0, LEFT);
-    Sleep(2.0);
-    motion.turn(60.0, RIGHT);
-    motion.driveBackwards(5.0);
-    ticketServo.SetDegree(170.0);
-
-    Sleep(0.5);
-    motion.travelTo(points->stopButtonX, points->stopButtonY);
-    LEFTPERCENT = leftReset;
-    RIGHTPERCENT = rightReset;
-
-    // motion.travelTo(RPS.X()+1.0,RPS.Y()-1.0,rpsTravelLog);
-
-    SD.FPrintf(data, "Stopping run at %f\n", TimeNow());
-    SD.FPrintf(data, "Total Run time: %f seconds\n", TimeNow() - runStart);
-
-    motion.driveForward(5.0, true);
-
-    SD.FClose(motion.rpsTravelLog);
-    SD.FClose(rpsCoordLog);
-    SD.FClose(data);
+    // Run's over, safe to write out whatever is left.
+    runLog.close();
+    telemetry.close();
 
     return 0;
 }
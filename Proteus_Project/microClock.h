@@ -0,0 +1,17 @@
+#ifndef MICROCLOCK_H
+#define MICROCLOCK_H
+
+#include <FEHUtility.h>
+
+/**
+ * @brief Current time as an integer number of microseconds. Wraps after about 71.6 minutes on the Proteus (2^32 us,
+ * unsigned long is 32 bits there), so always compare times by subtracting them (now - then), never with < or >.
+ * The double goes through a 64 bit integer first: converting it straight to a 32 bit unsigned long is undefined
+ * once it doesn't fit (ARM saturates it), while cutting a 64 bit integer down to 32 bits wraps it properly.
+ */
+inline unsigned long MicrosNow()
+{
+    return (unsigned long)(unsigned long long)(TimeNow() * 1000000.0);
+}
+
+#endif
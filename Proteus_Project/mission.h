@@ -0,0 +1,441 @@
+#ifndef MISSION_H
+#define MISSION_H
+
+#include <FEHUtility.h>
+#include <new>
+
+#include "cdsClassifier.h"
+#include "courseMap.h"
+#include "logRecords.h"
+#include "runLog.h"
+#include "scheduler.h"
+#include "waypoints.h"
+
+// Step operations. What a step's arguments mean for each one is in MissionStep.
+#define STEP_VIA 0
+#define STEP_TRAVEL 1
+#define STEP_FACE 2
+#define STEP_TURN 3
+#define STEP_FORWARD 4
+#define STEP_PUSH 5
+#define STEP_BACK 6
+#define STEP_SERVO 7
+#define STEP_FOLLOW 8
+#define STEP_LISTEN 9
+#define STEP_READ_COLOR 10
+#define STEP_WAIT 11
+#define STEP_MARK 12
+#define STEP_WAIT_MARK 13
+#define STEP_ROUTE 14
+#define NUM_STEP_OPS 15
+
+// Course tasks, steps are grouped by them. The ramps count as tasks too, worth nothing, so a plan (planner.h) can
+// put them wherever it changes level.
+#define TASK_JUKEBOX 0
+#define TASK_TRAY 1
+#define TASK_BUTTON 2
+#define TASK_BURGER 3
+#define TASK_LEVER 4
+#define TASK_TICKET 5
+#define TASK_STOP 6
+#define TASK_UP_RAMP 7
+#define TASK_DOWN_RAMP 8
+#define NUM_TASKS 9
+// No task, for Mission::dependsOn().
+#define MISSION_NO_TASK -1
+
+// When a step runs. WHEN_BLUE is anything but red, blue is the better guess if the light wasn't seen. The flavors
+// are in RPS.GetIceCream() order.
+#define WHEN_ALWAYS 0
+#define WHEN_RED 1
+#define WHEN_BLUE 2
+#define WHEN_VANILLA 3
+#define WHEN_TWIST 4
+#define WHEN_CHOCOLATE 5
+
+// What happens when a step still fails after its retries: carry on with the next step, or skip the rest of the
+// steps of its task.
+#define FAIL_NEXT 0
+#define FAIL_SKIP_TASK 1
+
+// Waypoint for a point taken from the pose at the start of the step.
+#define MISSION_HERE -1
+// Servos for STEP_SERVO.
+#define MISSION_TRAY 0
+#define MISSION_BURGER 1
+#define MISSION_TICKET 2
+// Most STEP_VIA points before a STEP_TRAVEL, and most corners in a STEP_ROUTE route.
+#define MISSION_MAX_VIA 8
+// Most STEP_ROUTE steps in a mission that get their route worked out before the run.
+#define MISSION_MAX_ROUTES 16
+// A STEP_TRAVEL worked if it ended this close (inches) to its point, a STEP_FACE if it ended this close (degrees)
+// to facing it.
+#define MISSION_ARRIVE_TOLERANCE 2.0
+#define MISSION_FACE_TOLERANCE 6.0
+// A STEP_READ_COLOR worked if it was at least this sure of the colour.
+#define MISSION_COLOR_CONFIDENCE 0.3
+
+/**
+ * @brief Name of a course task, for the LCD.
+ */
+inline const char *missionTaskName(int task)
+{
+    static const char *names[NUM_TASKS] = {"JUKEBOX", "TRAY", "BUTTON", "BURGER", "LEVER", "TICKET", "STOP",
+                                            "UP RAMP", "DOWN RAMP"};
+    return task >= 0 && task < NUM_TASKS ? names[task] : "?";
+}
+
+/**
+ * @brief One line of a mission table.
+ *
+ * What the arguments mean depends on op:
+ * STEP_VIA, STEP_TRAVEL, STEP_FACE - the point is (x of waypoint arg + a, y of waypoint arg2 + b). Either can be
+ *      MISSION_HERE for the pose when the step starts. VIA points are driven through by the next TRAVEL.
+ * STEP_ROUTE - like STEP_TRAVEL, but by the route around the obstacles on the course map that planRoutes() worked
+ *      out before the run. Straight there if it doesn't have one.
+ * STEP_TURN - a degrees on the encoders, positive is left
+ * STEP_FORWARD, STEP_BACK - a inches, closed loop. STEP_PUSH - a inches forward at the equilibrium percentages.
+ * STEP_SERVO - servo arg (MISSION_TRAY...) to a degrees, held there b seconds. arg2 1 waits for it, 0 carries on.
+ * STEP_FOLLOW - follows the line for a seconds
+ * STEP_LISTEN - starts sampling the CdS cell. STEP_READ_COLOR - classifies it.
+ * STEP_WAIT - a seconds. STEP_MARK - notes the time. STEP_WAIT_MARK - until a seconds after the last mark.
+ *
+ * budget is the most seconds one try of the step gets. 0 is no limit, only for steps that can't get stuck.
+ */
+struct MissionStep
+{
+    // TASK_*, STEP_*, WHEN_*
+    int task, op, when;
+    int arg, arg2;
+    float a, b;
+    float budget;
+    // Tries after the first, FAIL_*
+    int retries, onFail;
+};
+
+/**
+ * @brief Runs a mission table one step at a time. Each try of a step gets its time budget as the scheduler's
+ * deadline, so a motion that gets stuck is cancelled and the run carries on. A step that fails is tried again up
+ * to its retries, then either left or the rest of its task is skipped.
+ *
+ * Derive from it and implement perform() to carry out a step on the robot. perform() says whether the step did
+ * what it was meant to (see the MISSION_ tolerances); one that runs out of time has failed whatever it says.
+ * STEP_WAIT, STEP_MARK and STEP_WAIT_MARK are done here, everything else goes to perform().
+ *
+ * A task that fails takes the tasks that depend on it down with it (dependsOn()): a task whose steps carry on
+ * from where another left the robot, or that can only be done once another has been, is skipped if that one
+ * failed. That's what keeps the burger and the lever from being tried from the bottom of a ramp the robot never
+ * got up. Tasks that fail the same way (or are skipped) count as failed for the tasks behind them too.
+ *
+ * Every step goes in the run log as a LOG_MISSION record.
+ *
+ * planRoutes() works out every STEP_ROUTE route on a course map before the run, so no search runs during the match.
+ * Each route starts where the table should have left the robot by then, followed step by step from the start pose:
+ * travels, faces, turns and drives are added up, line following and anything the map can't see are taken as
+ * staying put. The robot drives from wherever it really is to the route's first corner.
+ *
+ * The following functions are included in the Mission class:
+ * void run(const MissionStep *steps, int count) - runs a mission table
+ * void dependsOn(int task, int follows, int needs) - notes which tasks a task depends on
+ * bool applies(const MissionStep &step) - whether a step's condition holds
+ * float pointX(const MissionStep &step, float hereX), pointY() - the point a step goes to
+ * bool addVia(float x, float y) - notes a point for the next STEP_TRAVEL
+ * int planRoutes(const MissionStep *steps, int count, CourseMap &map, float x, float y, float heading) - routes ahead
+ * int findRoute(int step) - which of the routes is for a step, -1 if none
+ * virtual bool perform(const MissionStep &step) - carries out one try of a step
+ */
+class Mission
+{
+public:
+    // Jukebox colour (CDS_*) and ice cream flavor, for the step conditions.
+    int color, flavor;
+    WaypointTable *points;
+    // Points from STEP_VIA for the next STEP_TRAVEL.
+    float viaX[MISSION_MAX_VIA], viaY[MISSION_MAX_VIA];
+    int vias;
+    // Steps that worked, failed after all their tries, were skipped because their task was, and extra tries.
+    int succeeded, failed, skipped, retried;
+    // Step running, TimeNow() of the last STEP_MARK.
+    int current;
+    double markTime;
+    // Per task: the task it carries on from and the task it needs done before (MISSION_NO_TASK if none), and
+    // whether it failed or was skipped this run.
+    int taskFollows[NUM_TASKS], taskNeeds[NUM_TASKS];
+    bool taskFailed[NUM_TASKS];
+    // Routes from planRoutes(): the step each is for, its points, and how many of them.
+    int routeStep[MISSION_MAX_ROUTES];
+    float routeX[MISSION_MAX_ROUTES][MISSION_MAX_VIA], routeY[MISSION_MAX_ROUTES][MISSION_MAX_VIA];
+    int routePoints[MISSION_MAX_ROUTES];
+    int routes;
+
+    Mission(WaypointTable &table, Scheduler &sched, RunLog &log)
+    {
+        points = &table;
+        scheduler = &sched;
+        runLog = &log;
+        color = CDS_NONE;
+        flavor = 0;
+        vias = 0;
+        succeeded = 0;
+        failed = 0;
+        skipped = 0;
+        retried = 0;
+        current = -1;
+        markTime = 0.0;
+        routes = 0;
+        for (int i = 0; i < NUM_TASKS; i++)
+        {
+            taskFollows[i] = MISSION_NO_TASK;
+            taskNeeds[i] = MISSION_NO_TASK;
+            taskFailed[i] = false;
+        }
+    }
+
+    virtual ~Mission()
+    {
+    }
+
+    virtual bool perform(const MissionStep &step) = 0;
+
+    /**
+     * @brief Notes what a task depends on. If either of them fails, the task is skipped.
+     *
+     * @param follows Task whose steps this one carries on from, MISSION_NO_TASK for none
+     * @param needs Task that has to have been done before, MISSION_NO_TASK for none
+     */
+    void dependsOn(int task, int follows, int needs)
+    {
+        taskFollows[task] = follows;
+        taskNeeds[task] = needs;
+    }
+
+    void run(const MissionStep *steps, int count)
+    {
+        int skipping = -1, task = MISSION_NO_TASK;
+        for (int i = 0; i < NUM_TASKS; i++)
+        {
+            taskFailed[i] = false;
+        }
+        for (current = 0; current < count; current++)
+        {
+            const MissionStep &step = steps[current];
+            if (!applies(step))
+            {
+                continue;
+            }
+            if (step.task != task)
+            {
+                // First step of a task: skip all of it if something it depends on failed.
+                task = step.task;
+                if (hasFailed(taskFollows[task]) || hasFailed(taskNeeds[task]))
+                {
+                    taskFailed[task] = true;
+                    skipping = task;
+                }
+            }
+            if (step.task == skipping)
+            {
+                skipped++;
+                runLog->add(LOG_MISSION, current, step.task, step.op, -1, 0, 0.0);
+                continue;
+            }
+            skipping = -1;
+            double stepStart = TimeNow();
+            bool worked = false;
+            int tries = 0;
+            while (!worked && tries <= step.retries)
+            {
+                if (tries > 0)
+                {
+                    retried++;
+                }
+                tries++;
+                scheduler->setDeadline(step.budget > 0.0 ? TimeNow() + step.budget : 0.0);
+                worked = attempt(step);
+                worked = worked && !scheduler->expired();
+                scheduler->setDeadline(0.0);
+                if (step.op == STEP_TRAVEL)
+                {
+                    // A retry goes straight for the point, the way there may be behind the robot by now.
+                    vias = 0;
+                }
+            }
+            runLog->add(LOG_MISSION, current, step.task, step.op, worked, tries, TimeNow() - stepStart);
+            if (worked)
+            {
+                succeeded++;
+            }
+            else
+            {
+                failed++;
+                if (step.onFail == FAIL_SKIP_TASK)
+                {
+                    skipping = step.task;
+                    taskFailed[step.task] = true;
+                }
+            }
+        }
+        current = -1;
+    }
+
+    bool applies(const MissionStep &step)
+    {
+        switch (step.when)
+        {
+        case WHEN_RED:
+            return color == CDS_RED;
+        case WHEN_BLUE:
+            return color != CDS_RED;
+        case WHEN_VANILLA:
+        case WHEN_TWIST:
+        case WHEN_CHOCOLATE:
+            return flavor == step.when - WHEN_VANILLA;
+        default:
+            return true;
+        }
+    }
+
+    float pointX(const MissionStep &step, float hereX)
+    {
+        return (step.arg == MISSION_HERE ? hereX : points->x(step.arg)) + step.a;
+    }
+
+    float pointY(const MissionStep &step, float hereY)
+    {
+        return (step.arg2 == MISSION_HERE ? hereY : points->y(step.arg2)) + step.b;
+    }
+
+    /**
+     * @brief Notes a point for the next STEP_TRAVEL to drive through.
+     *
+     * @return false if there are already MISSION_MAX_VIA of them
+     */
+    bool addVia(float x, float y)
+    {
+        if (vias >= MISSION_MAX_VIA)
+        {
+            return false;
+        }
+        viaX[vias] = x;
+        viaY[vias] = y;
+        vias++;
+        return true;
+    }
+
+    /**
+     * @brief Works out the route for every STEP_ROUTE in a table, see the class description. Steps for the other
+     * jukebox colour or flavors get one too, but only the steps that apply move the robot along.
+     *
+     * @param x, y, heading Pose the run starts from
+     * @return Routes found. A step without one (no way through, too many corners, or past MISSION_MAX_ROUTES) drives
+     * straight there. So does every step if there isn't the memory for the search.
+     */
+    int planRoutes(const MissionStep *steps, int count, CourseMap &map, float x, float y, float heading)
+    {
+        routes = 0;
+        // The search's working space is only needed here, so it's not kept around for the run.
+        MapSearch *search = new (std::nothrow) MapSearch;
+        for (int i = 0; i < count; i++)
+        {
+            const MissionStep &step = steps[i];
+            float toX = pointX(step, x), toY = pointY(step, y);
+            bool moves = applies(step);
+            switch (step.op)
+            {
+            case STEP_ROUTE:
+                if (search != NULL && routes < MISSION_MAX_ROUTES)
+                {
+                    int found = map.route(*search, x, y, toX, toY, routeX[routes], routeY[routes], MISSION_MAX_VIA);
+                    runLog->add(LOG_ROUTE, i, found, map.length, map.expanded);
+                    if (found > 0)
+                    {
+                        routeStep[routes] = i;
+                        routePoints[routes] = found;
+                        routes++;
+                    }
+                }
+                // The last leg of the route goes the same way as a straight travel from its last corner.
+                if (moves)
+                {
+                    int last = findRoute(i);
+                    if (last >= 0 && routePoints[last] > 1)
+                    {
+                        x = routeX[last][routePoints[last] - 2];
+                        y = routeY[last][routePoints[last] - 2];
+                    }
+                }
+                // fall through
+            case STEP_VIA:
+            case STEP_TRAVEL:
+            case STEP_FACE:
+                if (moves && hypot(toX - x, toY - y) > 0.1)
+                {
+                    heading = atan2(toY - y, toX - x) * 180.0 / M_PI;
+                }
+                if (moves && step.op != STEP_FACE)
+                {
+                    x = toX;
+                    y = toY;
+                }
+                break;
+            case STEP_TURN:
+                heading += moves ? step.a : 0.0;
+                break;
+            case STEP_FORWARD:
+            case STEP_PUSH:
+            case STEP_BACK:
+            {
+                float distance = moves ? (step.op == STEP_BACK ? -step.a : step.a) : 0.0;
+                x += distance * cos(heading * M_PI / 180.0);
+                y += distance * sin(heading * M_PI / 180.0);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        delete search;
+        return routes;
+    }
+
+    int findRoute(int step)
+    {
+        for (int i = 0; i < routes; i++)
+        {
+            if (routeStep[i] == step)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+private:
+    Scheduler *scheduler;
+    RunLog *runLog;
+
+    bool hasFailed(int task)
+    {
+        return task >= 0 && task < NUM_TASKS && taskFailed[task];
+    }
+
+    bool attempt(const MissionStep &step)
+    {
+        switch (step.op)
+        {
+        case STEP_WAIT:
+            scheduler->sleep(step.a);
+            return true;
+        case STEP_MARK:
+            markTime = TimeNow();
+            return true;
+        case STEP_WAIT_MARK:
+            scheduler->sleepUntil(markTime + step.a);
+            return true;
+        default:
+            return perform(step);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef MOTIONPROFILE_H
+#define MOTIONPROFILE_H
+
+#include <math.h>
+
+/**
+ * @brief Acceleration limited (S-curve) velocity profile for a move of a known number of encoder ticks.
+ *
+ * Every control tick update() is given how far the wheels have gone and hands back the wheel speed to aim for.
+ * The speed ramps up at no more than maxAccel, cruises at maxVelocity, and ramps back down so that it reaches
+ * minVelocity right at the target. The ramps are rounded off by limiting how fast the acceleration itself can
+ * change (maxJerk), which keeps the wheels from slipping at the start and the robot from rocking at the end.
+ *
+ * Slowing down is planned off the ticks still to go rather than off the clock, so a wheel that slipped or a
+ * loop that ran late still stops on the count instead of overshooting.
+ *
+ * The following functions are included in the MotionProfile class:
+ * void setLimits(float velocity, float accel, float jerk) - changes the limits (ticks/s, ticks/s^2, ticks/s^3)
+ * void start(float ticks) - plans a new move
+ * float update(float travelled, float dt) - wheel speed (ticks/s) to aim for now
+ */
+class MotionProfile
+{
+public:
+    float maxVelocity, maxAccel, maxJerk;
+    // Crawl speed at the very end of a move, so the wheels don't stall a few ticks short.
+    float minVelocity;
+    // Length of the move and the speed and acceleration currently being commanded.
+    float totalTicks, velocity, accel;
+
+    MotionProfile()
+    {
+        setLimits(25.0, 60.0, 400.0);
+        minVelocity = 4.0;
+        start(0.0);
+    }
+
+    /**
+     * @brief Changes the profile limits. Takes effect on the next start().
+     */
+    void setLimits(float maxVel, float maxAcc, float maxJrk)
+    {
+        maxVelocity = maxVel;
+        maxAccel = maxAcc;
+        maxJerk = maxJrk;
+    }
+
+    /**
+     * @brief Plans a new move from standstill.
+     *
+     * @param ticks Length of the move in encoder ticks
+     */
+    void start(float ticks)
+    {
+        totalTicks = ticks;
+        velocity = minVelocity;
+        accel = 0.0;
+    }
+
+    /**
+     * @brief Speed to aim for, given how far the move has got.
+     *
+     * @param travelled Encoder ticks travelled so far
+     * @param dt Seconds since the last update
+     * @return Wheel speed in ticks/s
+     */
+    float update(float travelled, float dt)
+    {
+        float remaining = totalTicks - travelled;
+        if (remaining < 0.0)
+        {
+            remaining = 0.0;
+        }
+        // Fastest we can be going and still slow down in time. Plan the braking a bit gentler than maxAccel,
+        // since the jerk limit rounds the start of the braking ramp off and costs a little distance.
+        float brakingAccel = 0.75 * maxAccel;
+        float wanted = sqrt(minVelocity * minVelocity + 2.0 * brakingAccel * remaining);
+        if (wanted > maxVelocity)
+        {
+            wanted = maxVelocity;
+        }
+
+        // Acceleration it would take to get there this tick, limited by maxAccel and by how fast accel may change.
+        float wantedAccel = dt > 0.0 ? (wanted - velocity) / dt : 0.0;
+        if (wantedAccel > maxAccel)
+        {
+            wantedAccel = maxAccel;
+        }
+        else if (wantedAccel < -maxAccel)
+        {
+            wantedAccel = -maxAccel;
+        }
+        float maxChange = maxJerk * dt;
+        if (wantedAccel > accel + maxChange)
+        {
+            accel += maxChange;
+        }
+        else if (wantedAccel < accel - maxChange)
+        {
+            accel -= maxChange;
+        }
+        else
+        {
+            accel = wantedAccel;
+        }
+        // Never brake later than the braking curve allows, the jerk limit only gets to round the corners.
+        velocity += accel * dt;
+        if (velocity > wanted && wanted < maxVelocity)
+        {
+            velocity = wanted;
+        }
+        if (velocity < minVelocity)
+        {
+            velocity = minVelocity;
+        }
+        if (velocity > maxVelocity)
+        {
+            velocity = maxVelocity;
+        }
+        return velocity;
+    }
+};
+
+#endif
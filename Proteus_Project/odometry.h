@@ -0,0 +1,267 @@
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include <math.h>
+
+#include "encoders.h"
+#include "loopTimer.h"
+#include "rpsCache.h"
+#include "scheduler.h"
+
+// The QR code is mounted sideways, RPS heading + 90 is the way the robot actually faces.
+#define QR_HEADING_OFFSET 90.0
+// How old an RPS fix is by the time we read it, in microseconds.
+#define RPS_LATENCY_US 150000
+// Fraction of the odometry error each RPS fix corrects. Low enough to smooth out RPS noise.
+#define RPS_POSITION_GAIN 0.35
+#define RPS_HEADING_GAIN 0.25
+// An RPS fix further off than this (inches) means the odometry has lost it, so the fix is taken as is.
+#define RPS_RESET_DISTANCE 4.0
+// Poses kept for latency compensation. At 200 Hz this is 320 ms of history.
+#define POSE_HISTORY 64
+
+/**
+ * @brief Differential drive odometry fused with RPS.
+ *
+ * Runs in the background as a scheduler task. Every tick it dead reckons from the encoder ticks since last time
+ * (encoders can't tell direction, so whoever drives the motors sets leftSign/rightSign), and whenever RPS has a new
+ * fix it nudges the pose toward it with a complementary filter. RPS fixes are about RPS_LATENCY_US old when they
+ * arrive, so each one is compared against where odometry thought the robot was back then, not where it is now.
+ * That gives a smooth pose at the control rate that doesn't need the robot to sit still for RPS to catch up.
+ *
+ * Headings are in degrees, 0-360, counterclockwise from the +x axis (RPS heading + QR_HEADING_OFFSET).
+ *
+ * The following functions are included in the Odometry class:
+ * void reset(float x, float y, float heading) - sets the pose
+ * bool step() - one dead reckoning / RPS update, called by the scheduler
+ * void predict() - dead reckons from the encoder ticks since the last call
+ * void fuse() - folds in the latest RPS fix if there is a new one
+ * float distanceTo(float x, float y) - straight line distance from the pose to a point
+ * float bearingTo(float x, float y) - heading that would point the robot at a point
+ * static float fromRpsHeading(float rpsHeading) - robot heading from a raw RPS heading
+ * static float angleDifference(float a, float b) - shortest signed angle from b to a
+ */
+class Odometry : public Task
+{
+public:
+    float x, y, heading;
+    // False until the first RPS fix, before that the pose means nothing.
+    bool hasFix;
+    // Direction each wheel is being driven, +1 forward, -1 backward.
+    float leftSign, rightSign;
+    float inchesPerTick, trackWidth;
+    float positionGain, headingGain;
+    unsigned long latencyMicros;
+    // RPS fixes used and fixes that reset the pose outright.
+    int fixes, resets;
+
+    /**
+     * @brief Construct a new Odometry object
+     *
+     * @param left Left wheel encoder
+     * @param right Right wheel encoder
+     * @param inPerTick Inches the wheel rolls per encoder tick
+     * @param track Distance between the wheels in inches
+     * @param rpsCache RPS front end to take fixes from
+     */
+    Odometry(Encoder &left, Encoder &right, float inPerTick, float track, RpsCache &rpsCache)
+    {
+        leftEncoder = &left;
+        rightEncoder = &right;
+        rps = &rpsCache;
+        inchesPerTick = inPerTick;
+        trackWidth = track;
+        positionGain = RPS_POSITION_GAIN;
+        headingGain = RPS_HEADING_GAIN;
+        latencyMicros = RPS_LATENCY_US;
+        leftSign = 1.0;
+        rightSign = 1.0;
+        fixes = 0;
+        resets = 0;
+        lastLeft = 0;
+        lastRight = 0;
+        lastFrame = 0;
+        reset(0.0, 0.0, 0.0);
+        hasFix = false;
+    }
+
+    /**
+     * @brief Sets the pose and forgets the history.
+     */
+    void reset(float newX, float newY, float newHeading)
+    {
+        x = newX;
+        y = newY;
+        heading = newHeading;
+        hasFix = true;
+        historyCount = 0;
+        historyNext = 0;
+        timer.start();
+    }
+
+    bool step()
+    {
+        if (!timer.due())
+        {
+            return false;
+        }
+        predict();
+        fuse();
+        timer.done();
+        // Runs for the whole run.
+        return false;
+    }
+
+    /**
+     * @brief Dead reckons from the encoder ticks since the last call.
+     */
+    void predict()
+    {
+        leftEncoder->Update();
+        rightEncoder->Update();
+        int left = leftEncoder->totalCounts;
+        int right = rightEncoder->totalCounts;
+        float dl = leftSign * (left - lastLeft) * inchesPerTick;
+        float dr = rightSign * (right - lastRight) * inchesPerTick;
+        lastLeft = left;
+        lastRight = right;
+
+        // Move along the average of the old and new heading.
+        float dTheta = (dr - dl) / trackWidth;
+        float mid = heading * M_PI / 180.0 + dTheta / 2.0;
+        x += (dl + dr) / 2.0 * cos(mid);
+        y += (dl + dr) / 2.0 * sin(mid);
+        heading = wrap360(heading + dTheta * 180.0 / M_PI);
+
+        historyX[historyNext] = x;
+        historyY[historyNext] = y;
+        historyHeading[historyNext] = heading;
+        historyMicros[historyNext] = MicrosNow();
+        historyNext = (historyNext + 1) % POSE_HISTORY;
+        if (historyCount < POSE_HISTORY)
+        {
+            historyCount++;
+        }
+    }
+
+    /**
+     * @brief Folds in the latest RPS frame, if there is a new one. No fix and deadzone frames are ignored,
+     * odometry carries on by itself until RPS comes back.
+     */
+    void fuse()
+    {
+        // Someone else may have read the new frame out of the cache already, so go by the frame count.
+        rps->update();
+        if (rps->frames == lastFrame || rps->sample.state != RPS_FIX)
+        {
+            return;
+        }
+        lastFrame = rps->frames;
+        correct(rps->sample.x, rps->sample.y, fromRpsHeading(rps->sample.heading), rps->sample.micros - latencyMicros);
+    }
+
+    /**
+     * @brief Corrects the pose with a position fix that was true at a given time.
+     *
+     * @param fixX X of the fix
+     * @param fixY Y of the fix
+     * @param fixHeading Heading of the fix (robot heading, not raw RPS)
+     * @param fixMicros MicrosNow() time at which the fix was true
+     */
+    void correct(float fixX, float fixY, float fixHeading, unsigned long fixMicros)
+    {
+        fixes++;
+        // Where did odometry think we were back when the fix was taken?
+        float thenX = x, thenY = y, thenHeading = heading;
+        for (int i = 1; i <= historyCount; i++)
+        {
+            int index = (historyNext - i + POSE_HISTORY) % POSE_HISTORY;
+            thenX = historyX[index];
+            thenY = historyY[index];
+            thenHeading = historyHeading[index];
+            if ((long)(historyMicros[index] - fixMicros) <= 0)
+            {
+                break;
+            }
+        }
+        float errorX = fixX - thenX, errorY = fixY - thenY;
+        float errorHeading = angleDifference(fixHeading, thenHeading);
+        if (!hasFix || sqrt(errorX * errorX + errorY * errorY) > RPS_RESET_DISTANCE)
+        {
+            resets++;
+            reset(fixX, fixY, fixHeading);
+            return;
+        }
+        // The error back then is still the error now, odometry has only added motion on top of it since.
+        x += positionGain * errorX;
+        y += positionGain * errorY;
+        heading = wrap360(heading + headingGain * errorHeading);
+    }
+
+    /**
+     * @brief Straight line distance from the current pose to a point, in inches
+     */
+    float distanceTo(float toX, float toY)
+    {
+        return sqrt((toX - x) * (toX - x) + (toY - y) * (toY - y));
+    }
+
+    /**
+     * @brief Heading (degrees, 0-360) that would point the robot straight at a point
+     */
+    float bearingTo(float toX, float toY)
+    {
+        return wrap360(atan2(toY - y, toX - x) * 180.0 / M_PI);
+    }
+
+    /**
+     * @brief Robot heading (0-360) from a raw RPS heading, corrected for the sideways QR code
+     */
+    static float fromRpsHeading(float rpsHeading)
+    {
+        return wrap360(rpsHeading + QR_HEADING_OFFSET);
+    }
+
+    /**
+     * @brief Wraps an angle in degrees into 0-360
+     */
+    static float wrap360(float angle)
+    {
+        while (angle >= 360.0)
+        {
+            angle -= 360.0;
+        }
+        while (angle < 0.0)
+        {
+            angle += 360.0;
+        }
+        return angle;
+    }
+
+    /**
+     * @brief Shortest signed angle from b to a in degrees, -180 to 180. Positive means a is counterclockwise (left) of b.
+     */
+    static float angleDifference(float a, float b)
+    {
+        float difference = wrap360(a - b);
+        if (difference > 180.0)
+        {
+            difference -= 360.0;
+        }
+        return difference;
+    }
+
+private:
+    Encoder *leftEncoder, *rightEncoder;
+    RpsCache *rps;
+    LoopTimer timer;
+    // Encoder totals at the last predict(), last RPS frame fused.
+    int lastLeft, lastRight;
+    unsigned long lastFrame;
+    // Ring buffer of recent poses for latency compensation.
+    float historyX[POSE_HISTORY], historyY[POSE_HISTORY], historyHeading[POSE_HISTORY];
+    unsigned long historyMicros[POSE_HISTORY];
+    int historyCount, historyNext;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef OPTOARRAY_H
+#define OPTOARRAY_H
+
+#include <FEHIO.h>
+
+#include "microClock.h"
+
+// Sensor indexes into an OptoSnapshot.
+#define OPTO_LEFT 0
+#define OPTO_MID 1
+#define OPTO_RIGHT 2
+#define NUM_OPTOS 3
+// Conversions averaged per sensor per snapshot. The three sensors are read in turn, so each average spans the same
+// stretch of time.
+#define OPTO_OVERSAMPLE 4
+// How much of each new average goes into the filtered voltage. At the 200 Hz control rate this is a few ms of lag,
+// enough to take out single bad conversions without slowing the steering down.
+#define OPTO_FILTER 0.5
+// A sensor goes on the line above this much of the way from its off voltage to its on voltage, and off it again
+// below OPTO_OFF_LINE, so it doesn't chatter on the edge of the tape.
+#define OPTO_ON_LINE 0.6
+#define OPTO_OFF_LINE 0.4
+
+/**
+ * @brief Everything the optosensors saw at one instant. Filled in by OptoArray::sample() and handed out const, so
+ * the controller and the LCD make their decisions off the same readings until the next sample().
+ */
+struct OptoSnapshot
+{
+    // Filtered voltages, left/mid/right.
+    float volts[NUM_OPTOS];
+    // Same, scaled to 0 (off the line) to 1 (right over it) between the sensor's off and on voltages.
+    float weight[NUM_OPTOS];
+    // Whether each sensor is over the line, with hysteresis.
+    bool onLine[NUM_OPTOS];
+    // MicrosNow() when the snapshot was taken
+    unsigned long micros;
+};
+
+/**
+ * @brief The three line following optosensors, read once per control tick.
+ *
+ * sample() is the only place the analog pins get read. Each sensor is converted OPTO_OVERSAMPLE times and averaged,
+ * the average goes through a short low pass filter, and the result is scaled between the voltages the sensor reads
+ * off and on the line (set with setLevels(), each sensor reads differently). Anything that wants to know about the
+ * line takes the snapshot instead of reading the pins again.
+ *
+ * The following functions are included in the OptoArray class:
+ * void setLevels(int sensor, float off, float on) - voltages one sensor reads off and on the line
+ * const OptoSnapshot &sample() - reads all three sensors and returns the new snapshot
+ * const OptoSnapshot &latest() - the last snapshot, without reading anything
+ * void restart() - forgets the filter and hysteresis state, for the start of a new line follow
+ */
+class OptoArray
+{
+public:
+    // Snapshots taken.
+    unsigned long samples;
+
+    OptoArray(FEHIO::FEHIOPin leftPin, FEHIO::FEHIOPin midPin, FEHIO::FEHIOPin rightPin)
+        : left(leftPin), mid(midPin), right(rightPin)
+    {
+        pins[OPTO_LEFT] = &left;
+        pins[OPTO_MID] = &mid;
+        pins[OPTO_RIGHT] = &right;
+        for (int i = 0; i < NUM_OPTOS; i++)
+        {
+            offVolts[i] = 0.0;
+            onVolts[i] = 3.3;
+            snapshot.volts[i] = 0.0;
+            snapshot.weight[i] = 0.0;
+            snapshot.onLine[i] = false;
+        }
+        snapshot.micros = 0;
+        samples = 0;
+        fresh = true;
+    }
+
+    /**
+     * @brief Sets the voltages one sensor reads off the line and right over it.
+     *
+     * @param sensor OPTO_LEFT, OPTO_MID or OPTO_RIGHT
+     */
+    void setLevels(int sensor, float off, float on)
+    {
+        offVolts[sensor] = off;
+        onVolts[sensor] = on;
+    }
+
+    /**
+     * @brief Forgets the filter and hysteresis state. The next sample() starts from its own readings with every
+     * sensor off the line, instead of being pulled towards wherever the line was at the end of the last follow.
+     */
+    void restart()
+    {
+        for (int i = 0; i < NUM_OPTOS; i++)
+        {
+            snapshot.onLine[i] = false;
+        }
+        fresh = true;
+    }
+
+    /**
+     * @brief Reads all three sensors, oversampled and filtered, and makes a new snapshot of them.
+     */
+    const OptoSnapshot &sample()
+    {
+        float sum[NUM_OPTOS] = {0.0, 0.0, 0.0};
+        for (int n = 0; n < OPTO_OVERSAMPLE; n++)
+        {
+            for (int i = 0; i < NUM_OPTOS; i++)
+            {
+                sum[i] += pins[i]->Value();
+            }
+        }
+        for (int i = 0; i < NUM_OPTOS; i++)
+        {
+            float average = sum[i] / OPTO_OVERSAMPLE;
+            // Nothing to filter against on the first snapshot after a restart.
+            if (fresh)
+            {
+                snapshot.volts[i] = average;
+            }
+            else
+            {
+                snapshot.volts[i] += OPTO_FILTER * (average - snapshot.volts[i]);
+            }
+            float weight = (snapshot.volts[i] - offVolts[i]) / (onVolts[i] - offVolts[i]);
+            snapshot.weight[i] = weight < 0.0 ? 0.0 : (weight > 1.0 ? 1.0 : weight);
+            if (snapshot.onLine[i])
+            {
+                snapshot.onLine[i] = snapshot.weight[i] >= OPTO_OFF_LINE;
+            }
+            else
+            {
+                snapshot.onLine[i] = snapshot.weight[i] > OPTO_ON_LINE;
+            }
+        }
+        snapshot.micros = MicrosNow();
+        samples++;
+        fresh = false;
+        return snapshot;
+    }
+
+    const OptoSnapshot &latest()
+    {
+        return snapshot;
+    }
+
+private:
+    AnalogInputPin left, mid, right;
+    AnalogInputPin *pins[NUM_OPTOS];
+    float offVolts[NUM_OPTOS], onVolts[NUM_OPTOS];
+    OptoSnapshot snapshot;
+    // Set until the first sample() after construction or restart().
+    bool fresh;
+};
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <math.h>
+
+#include "mission.h"
+#include "waypoints.h"
+
+// Course levels. The ramps go between them.
+#define LEVEL_LOWER 0
+#define LEVEL_UPPER 1
+// For TaskModel::follows and needs: no such task. The same as the mission's, main() hands them to it as they are.
+#define PLAN_NONE MISSION_NO_TASK
+// Seconds from the start light to the end of the run.
+#define PLAN_TIME_LIMIT 120.0
+// Travel between tasks is estimated at this average speed (in/s, straight line) plus a fixed time for the turn
+// towards the point and the speed ramps. Fitted so the plan for the sim's usual run comes out at its run time.
+#define PLAN_TRAVEL_SPEED 10.0
+#define PLAN_TRAVEL_OVERHEAD 0.5
+// Points closer than this (inches) need no travel at all.
+#define PLAN_SAME_PLACE 1.0
+// Most mission steps in a plan.
+#define MAX_PLAN_STEPS 96
+
+/**
+ * @brief What the planner knows about one course task.
+ */
+struct TaskModel
+{
+    // TASK_*
+    int task;
+    // Points for getting it done, and the chance it gets done when tried (0 to 1).
+    float points, chance;
+    // Seconds it takes once at entry, not counting the travel there.
+    float seconds;
+    // Waypoints it starts and ends at.
+    int entry, exit;
+    // Level it starts on and ends on (different only for the ramps).
+    int level, endLevel;
+    // Task that has to come right before it (its steps carry on from where that one leaves the robot), and task
+    // that has to have been done some time before (a ramp counts once the plan has been up or down it). PLAN_NONE
+    // for either if there isn't one. The mission skips the task if either of them fails (Mission::dependsOn()),
+    // which is all they do for the ramps, the planner puts those in by level.
+    int follows, needs;
+    // Ends the run. The plan always finishes with it, whatever else gets dropped.
+    bool final;
+};
+
+/**
+ * @brief Picks which tasks to do and in what order for the most expected points inside the run time limit.
+ *
+ * Every order of every subset of the tasks is tried (there are only a handful of tasks, a few thousand orders at
+ * most), subject to each task's follows and needs. When the next task is on the other level the ramp that goes
+ * there is put in first. A plan is scored on points times chance for each task. Its time is the tasks' own seconds
+ * plus the travel between them, estimated off the waypoint table. Plans that run past the time limit are out.
+ * Between plans worth the same the quicker one wins.
+ *
+ * build() turns the plan into a mission table by copying the steps of each task, in plan order, out of the full
+ * table.
+ *
+ * The following functions are included in the MissionPlanner class:
+ * bool plan(float startX, float startY, double timeLimit) - finds the best plan from a start position
+ * int build(const MissionStep *table, int count, MissionStep *out, int max) - the plan as mission steps
+ * float travelSeconds(float fromX, float fromY, float toX, float toY) - estimated travel time between two points
+ */
+class MissionPlanner
+{
+public:
+    const TaskModel *models;
+    int numModels;
+    WaypointTable *points;
+    // Best plan found: tasks in order (ramps included), how many, its expected points and estimated seconds,
+    // and the estimated time each task finishes.
+    int order[NUM_TASKS * 2];
+    int length;
+    float expected, seconds;
+    float finishTime[NUM_TASKS * 2];
+    // Plans looked at by the last plan().
+    long searched;
+
+    MissionPlanner(const TaskModel *taskModels, int count, WaypointTable &table)
+    {
+        models = taskModels;
+        numModels = count;
+        points = &table;
+        length = 0;
+        expected = 0.0;
+        seconds = 0.0;
+        searched = 0;
+    }
+
+    /**
+     * @brief Finds the plan worth the most expected points that finishes inside timeLimit.
+     *
+     * @return false if not even the final task fits
+     */
+    bool plan(float startX, float startY, double timeLimit)
+    {
+        limit = timeLimit;
+        length = 0;
+        expected = -1.0;
+        seconds = 0.0;
+        searched = 0;
+        trialLength = 0;
+        search(0, PLAN_NONE, startX, startY, LEVEL_LOWER, 0.0, 0.0);
+        if (expected < 0.0)
+        {
+            expected = 0.0;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Copies the steps of every task in the plan, in plan order, out of a full mission table.
+     *
+     * @return Steps written to out
+     */
+    int build(const MissionStep *table, int count, MissionStep *out, int max)
+    {
+        int written = 0;
+        for (int i = 0; i < length; i++)
+        {
+            for (int j = 0; j < count && written < max; j++)
+            {
+                if (table[j].task == order[i])
+                {
+                    out[written++] = table[j];
+                }
+            }
+        }
+        return written;
+    }
+
+    float travelSeconds(float fromX, float fromY, float toX, float toY)
+    {
+        float distance = hypot(toX - fromX, toY - fromY);
+        return distance < PLAN_SAME_PLACE ? 0.0 : distance / PLAN_TRAVEL_SPEED + PLAN_TRAVEL_OVERHEAD;
+    }
+
+private:
+    double limit;
+    // Plan being tried.
+    int trial[NUM_TASKS * 2];
+    float trialFinish[NUM_TASKS * 2];
+    int trialLength;
+
+    /**
+     * @brief Tries every task that can go next, and scores the plan once the final task is in.
+     *
+     * @param done Bit per task already in the plan
+     * @param last Task right before, PLAN_NONE at the start
+     * @param x, y Where the robot is
+     * @param level Level it's on
+     * @param time Estimated seconds so far
+     * @param score Expected points so far
+     */
+    void search(int done, int last, float x, float y, int level, float time, float score)
+    {
+        for (int i = 0; i < numModels; i++)
+        {
+            const TaskModel &model = models[i];
+            if ((done & (1 << model.task)) || model.level != model.endLevel)
+            {
+                continue;
+            }
+            int mark = trialLength;
+            int before = last, doneBefore = done;
+            float atX = x, atY = y, at = time;
+            if (model.level != level)
+            {
+                const TaskModel *ramp = rampFrom(level);
+                if (ramp == NULL)
+                {
+                    continue;
+                }
+                at += travelSeconds(atX, atY, points->x(ramp->entry), points->y(ramp->entry)) + ramp->seconds;
+                atX = points->x(ramp->exit);
+                atY = points->y(ramp->exit);
+                before = ramp->task;
+                doneBefore |= 1 << ramp->task;
+                add(ramp->task, at);
+            }
+            if (model.needs != PLAN_NONE && !(doneBefore & (1 << model.needs)))
+            {
+                trialLength = mark;
+                continue;
+            }
+            if (model.follows != PLAN_NONE && model.follows != before)
+            {
+                trialLength = mark;
+                continue;
+            }
+            at += travelSeconds(atX, atY, points->x(model.entry), points->y(model.entry)) + model.seconds;
+            if (at > limit)
+            {
+                trialLength = mark;
+                continue;
+            }
+            add(model.task, at);
+            float worth = score + model.points * model.chance;
+            if (model.final)
+            {
+                searched++;
+                if (worth > expected + 0.001 || (worth > expected - 0.001 && at < seconds))
+                {
+                    expected = worth;
+                    seconds = at;
+                    length = trialLength;
+                    for (int j = 0; j < trialLength; j++)
+                    {
+                        order[j] = trial[j];
+                        finishTime[j] = trialFinish[j];
+                    }
+                }
+            }
+            else
+            {
+                search(doneBefore | (1 << model.task), model.task, points->x(model.exit), points->y(model.exit),
+                       model.endLevel, at, worth);
+            }
+            trialLength = mark;
+        }
+    }
+
+    const TaskModel *rampFrom(int level)
+    {
+        for (int i = 0; i < numModels; i++)
+        {
+            if (models[i].level == level && models[i].endLevel != level)
+            {
+                return &models[i];
+            }
+        }
+        return NULL;
+    }
+
+    void add(int task, float at)
+    {
+        trial[trialLength] = task;
+        trialFinish[trialLength] = at;
+        trialLength++;
+    }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef PUREPURSUIT_H
+#define PUREPURSUIT_H
+
+#include <math.h>
+
+// Most waypoints in one path, not counting the start point.
+#define MAX_PATH_POINTS 16
+// How far ahead along the path the robot aims, in inches. Shorter follows corners tighter, longer is smoother.
+#define LOOKAHEAD_DISTANCE 6.0
+
+/**
+ * @brief Pure pursuit geometry for following a path of waypoints.
+ *
+ * The path starts wherever the robot is and runs through each waypoint in turn. Every control tick the robot's
+ * position is projected onto the path, a goal point is picked LOOKAHEAD_DISTANCE further along it, and
+ * curvature() gives the arc that would take the robot from where it is to the goal point. Driving the wheels at
+ * speeds in that ratio cuts the corners smoothly instead of stopping and turning at each waypoint.
+ *
+ * Past the last waypoint the path carries on straight in the direction of the last segment, so the robot stays
+ * pointed along it on the final approach instead of hunting for a goal point it is sitting on.
+ *
+ * Positions are in inches, headings in degrees counterclockwise from +x (same as Odometry).
+ *
+ * The following functions are included in the PurePursuit class:
+ * void start(float x, float y, const float *xs, const float *ys, int count) - sets a new path from (x, y)
+ * float remaining(float x, float y) - distance left along the path, negative once past the end
+ * float curvature(float x, float y, float heading) - curvature (1/inches, positive is left) to steer along
+ */
+class PurePursuit
+{
+public:
+    // Path points, the start point first. numPoints includes the start.
+    float pathX[MAX_PATH_POINTS + 1], pathY[MAX_PATH_POINTS + 1];
+    int numPoints;
+    // Segment the robot is currently on (pathX[segment] to pathX[segment + 1]).
+    int segment;
+    float lookahead;
+    // Goal point picked by the last curvature() call.
+    float goalX, goalY;
+
+    PurePursuit()
+    {
+        lookahead = LOOKAHEAD_DISTANCE;
+        numPoints = 0;
+        segment = 0;
+        goalX = 0.0;
+        goalY = 0.0;
+    }
+
+    /**
+     * @brief Sets a new path. Waypoints past MAX_PATH_POINTS are dropped.
+     *
+     * @param x Start X (where the robot is now)
+     * @param y Start Y
+     * @param xs Waypoint X coordinates
+     * @param ys Waypoint Y coordinates
+     * @param count Number of waypoints
+     */
+    void start(float x, float y, const float *xs, const float *ys, int count)
+    {
+        if (count > MAX_PATH_POINTS)
+        {
+            count = MAX_PATH_POINTS;
+        }
+        pathX[0] = x;
+        pathY[0] = y;
+        for (int i = 0; i < count; i++)
+        {
+            pathX[i + 1] = xs[i];
+            pathY[i + 1] = ys[i];
+        }
+        numPoints = count + 1;
+        segment = 0;
+        goalX = pathX[numPoints - 1];
+        goalY = pathY[numPoints - 1];
+    }
+
+    /**
+     * @brief Distance left along the path from the robot's projection onto it to the last waypoint.
+     * Also moves on to the next segment once the robot is past the end of the current one, or closer to the next.
+     *
+     * @return Inches to go, negative once past the last waypoint
+     */
+    float remaining(float x, float y)
+    {
+        if (numPoints < 2)
+        {
+            return 0.0;
+        }
+        float t = progress(x, y);
+        float left = (1.0 - t) * segmentLength(segment);
+        for (int i = segment + 1; i < numPoints - 1; i++)
+        {
+            left += segmentLength(i);
+        }
+        return left;
+    }
+
+    /**
+     * @brief Curvature of the arc from the robot to the goal point.
+     *
+     * @param x Robot X
+     * @param y Robot Y
+     * @param heading Robot heading in degrees
+     * @return Curvature in 1/inches, positive curves left
+     */
+    float curvature(float x, float y, float heading)
+    {
+        if (numPoints < 2)
+        {
+            return 0.0;
+        }
+        // Walk lookahead inches along the path from the robot's projection onto it.
+        float t = progress(x, y);
+        if (t < 0.0)
+        {
+            t = 0.0;
+        }
+        float toGo = lookahead;
+        int i = segment;
+        float along = t * segmentLength(i);
+        while (i < numPoints - 2 && along + toGo > segmentLength(i))
+        {
+            toGo -= segmentLength(i) - along;
+            along = 0.0;
+            i++;
+        }
+        // On the last segment the goal may run past the end, which just extends the last segment.
+        float length = segmentLength(i);
+        float dirX = 1.0, dirY = 0.0;
+        if (length > 0.0)
+        {
+            dirX = (pathX[i + 1] - pathX[i]) / length;
+            dirY = (pathY[i + 1] - pathY[i]) / length;
+        }
+        goalX = pathX[i] + dirX * (along + toGo);
+        goalY = pathY[i] + dirY * (along + toGo);
+
+        // Arc through the robot and the goal point, tangent to the heading: k = 2 sin(alpha) / distance.
+        float dx = goalX - x, dy = goalY - y;
+        float distance = sqrt(dx * dx + dy * dy);
+        if (distance < 0.01)
+        {
+            return 0.0;
+        }
+        float alpha = atan2(dy, dx) - heading * M_PI / 180.0;
+        return 2.0 * sin(alpha) / distance;
+    }
+
+private:
+    float segmentLength(int i)
+    {
+        float dx = pathX[i + 1] - pathX[i], dy = pathY[i + 1] - pathY[i];
+        return sqrt(dx * dx + dy * dy);
+    }
+
+    // How far along segment i the point projects, 0 at its start and 1 at its end (can be outside 0-1).
+    float projection(int i, float x, float y)
+    {
+        float dx = pathX[i + 1] - pathX[i], dy = pathY[i + 1] - pathY[i];
+        float lengthSquared = dx * dx + dy * dy;
+        return lengthSquared > 0.0 ? ((x - pathX[i]) * dx + (y - pathY[i]) * dy) / lengthSquared : 1.0;
+    }
+
+    // Distance from the point to the closest point of segment i.
+    float distanceTo(int i, float x, float y)
+    {
+        float t = fmin(fmax(projection(i, x, y), 0.0), 1.0);
+        return hypot(pathX[i] + t * (pathX[i + 1] - pathX[i]) - x, pathY[i] + t * (pathY[i + 1] - pathY[i]) - y);
+    }
+
+    /**
+     * @brief Projects the robot onto the current segment, moving on to later segments while it's past the end of
+     * the current one or closer to the next one. The second is what gets it round a sharp corner: it cuts inside,
+     * so it never gets level with the end of the segment it came in on.
+     *
+     * @return How far along the current segment the robot is, 0 at the start and 1 at the end (can be outside 0-1)
+     */
+    float progress(float x, float y)
+    {
+        while (true)
+        {
+            float t = projection(segment, x, y);
+            if (segment >= numPoints - 2 || (t < 1.0 && distanceTo(segment, x, y) <= distanceTo(segment + 1, x, y)))
+            {
+                return t;
+            }
+            segment++;
+        }
+    }
+};
+
+#endif
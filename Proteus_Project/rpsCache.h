@@ -0,0 +1,183 @@
+#ifndef RPSCACHE_H
+#define RPSCACHE_H
+
+#include <FEHRPS.h>
+
+#include "microClock.h"
+#include "scheduler.h"
+
+// RPS states. RPS reports no fix as -1 and the deadzone as -2.
+#define RPS_FIX 0
+#define RPS_NO_FIX -1
+#define RPS_DEADZONE -2
+// How long (us) RPS can go without a new fix before lost() is called with the state it's stuck in.
+#define RPS_NO_FIX_TIMEOUT_US 1000000
+#define RPS_DEADZONE_TIMEOUT_US 500000
+// Times to re-read a frame that changed halfway through being read.
+#define RPS_READ_RETRIES 3
+
+/**
+ * @brief One RPS frame: position and heading from the same update, when it arrived and what state RPS was in.
+ */
+struct RpsSample
+{
+    float x, y, heading;
+    // RPS_FIX, RPS_NO_FIX or RPS_DEADZONE
+    int state;
+    // MicrosNow() when this frame was first seen
+    unsigned long micros;
+};
+
+/**
+ * @brief Front end for RPS. Keeps the latest frame as one consistent snapshot with a timestamp.
+ *
+ * RPS.X(), RPS.Y() and RPS.Heading() are separate calls and the frame can change in between them, so update()
+ * reads all three and then reads X and Y again, and only keeps the frame if nothing moved underneath it. A frame
+ * only counts as new when it differs from the last one, which is also what the update rate goes off. RPS has no
+ * frame counter, so a robot standing still looks the same as RPS that's stopped updating; nothing here tries to
+ * tell them apart.
+ *
+ * No fix and the deadzone are states rather than magic numbers. Nothing ever waits on RPS forever: waitForFix()
+ * gives up after a timeout, and if RPS stays lost longer than RPS_NO_FIX_TIMEOUT_US / RPS_DEADZONE_TIMEOUT_US
+ * the lost() hook is called once so the run can fall back on something else. Hooks are called from inside the
+ * scheduler, so they must not block.
+ *
+ * The following functions are included in the RpsCache class:
+ * bool update() - reads RPS, returns true if there is a new frame
+ * RpsSample current() - update() and return the latest frame
+ * bool waitForFix(Scheduler &scheduler, double timeout) - keeps the scheduler going until there's a fix or the timeout runs out
+ */
+class RpsCache
+{
+public:
+    RpsSample sample;
+    // New frames per second, smoothed.
+    float updateRate;
+    // Frames seen, frames that had to be re-read, times lost() was called.
+    unsigned long frames, tornReads, dropouts;
+    unsigned long noFixTimeoutMicros, deadzoneTimeoutMicros;
+    // Called once with RPS_NO_FIX or RPS_DEADZONE when RPS has been lost for longer than the timeout. May be NULL.
+    void (*lost)(int state);
+
+    RpsCache()
+    {
+        sample.x = -1.0;
+        sample.y = -1.0;
+        sample.heading = -1.0;
+        sample.state = RPS_NO_FIX;
+        sample.micros = MicrosNow();
+        updateRate = 0.0;
+        frames = 0;
+        tornReads = 0;
+        dropouts = 0;
+        noFixTimeoutMicros = RPS_NO_FIX_TIMEOUT_US;
+        deadzoneTimeoutMicros = RPS_DEADZONE_TIMEOUT_US;
+        lost = NULL;
+        lostSince = sample.micros;
+        lostReported = false;
+    }
+
+    /**
+     * @brief Reads RPS and keeps the frame if it's new.
+     *
+     * @return true if a new frame came in
+     */
+    bool update()
+    {
+        float x, y, heading;
+        for (int i = 0; i <= RPS_READ_RETRIES; i++)
+        {
+            x = RPS.X();
+            y = RPS.Y();
+            heading = RPS.Heading();
+            if (RPS.X() == x && RPS.Y() == y)
+            {
+                break;
+            }
+            tornReads++;
+        }
+        unsigned long now = MicrosNow();
+        int state = RPS_FIX;
+        if (x == -2.0 || y == -2.0)
+        {
+            state = RPS_DEADZONE;
+        }
+        else if (x < 0.0 || y < 0.0 || heading < 0.0)
+        {
+            state = RPS_NO_FIX;
+        }
+        checkLost(state, now);
+
+        if (x == sample.x && y == sample.y && heading == sample.heading && state == sample.state)
+        {
+            return false;
+        }
+        if (frames > 0 && now != sample.micros)
+        {
+            float rate = 1000000.0 / (now - sample.micros);
+            updateRate = updateRate == 0.0 ? rate : 0.8 * updateRate + 0.2 * rate;
+        }
+        sample.x = x;
+        sample.y = y;
+        sample.heading = heading;
+        sample.state = state;
+        sample.micros = now;
+        frames++;
+        return true;
+    }
+
+    /**
+     * @brief Latest frame, after checking RPS for a new one.
+     */
+    RpsSample current()
+    {
+        update();
+        return sample;
+    }
+
+    /**
+     * @brief Keeps the scheduler going until RPS has a fix, or gives up (timeout or the scheduler's deadline).
+     *
+     * @param scheduler Scheduler to keep ticking while waiting
+     * @param timeout Seconds to wait at most
+     * @return true if there is a fix
+     */
+    bool waitForFix(Scheduler &scheduler, double timeout)
+    {
+        double giveUp = TimeNow() + timeout;
+        update();
+        while (sample.state != RPS_FIX && TimeNow() < giveUp && !scheduler.expired())
+        {
+            scheduler.tick();
+            update();
+        }
+        return sample.state == RPS_FIX;
+    }
+
+private:
+    // Last time RPS had a fix, and whether lost() has been called since.
+    unsigned long lostSince;
+    bool lostReported;
+
+    void checkLost(int state, unsigned long now)
+    {
+        if (state == RPS_FIX)
+        {
+            lostSince = now;
+            lostReported = false;
+            return;
+        }
+        unsigned long timeout = state == RPS_DEADZONE ? deadzoneTimeoutMicros : noFixTimeoutMicros;
+        if (!lostReported && now - lostSince >= timeout)
+        {
+            lostReported = true;
+            dropouts++;
+            if (lost != NULL)
+            {
+                lost(state);
+            }
+        }
+    }
+};
+
+#endif
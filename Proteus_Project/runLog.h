@@ -0,0 +1,172 @@
+#ifndef RUNLOG_H
+#define RUNLOG_H
+
+#include <FEHSD.h>
+#include <stdio.h>
+
+#include "logRecords.h"
+#include "microClock.h"
+#include "scheduler.h"
+
+// Records the RAM buffer holds (28 bytes each, 14 KB). A simulated run logs 264-274, 245-255 of them after the start
+// light, and there's no saying the robot stops long enough to flush any of those before the end. Twice that leaves
+// room for retries and a slow run.
+#define LOG_CAPACITY 512
+// Most records written per scheduler pass while idle, keeps each pass short.
+#define LOG_FLUSH_BATCH 2
+
+/**
+ * @brief Run log. Logging a record only copies it into a RAM ring buffer, the SD card is written in the background
+ * while no control loop is running, so logging never holds up a motion.
+ *
+ * Every run gets its own file, run000.log, run001.log, ... (the next number is kept in runnum.txt). The SD library
+ * can only write text, so each record goes to the card as one fixed width line of hex digits (see logRecords.h).
+ * Floats are written as their bit patterns, nothing gets rounded. Simulation/logDecode turns a log back into CSV.
+ *
+ * If the buffer fills up before it can be flushed, new records are dropped and counted, and a LOG_DROPPED record
+ * is written once there's room again.
+ *
+ * The following functions are included in the RunLog class:
+ * void open() - opens the next run's file and starts flushing on the scheduler
+ * void add(int type, int arg, float v0, ...) - logs a record
+ * bool step() - writes a few records if the robot is idle, called by the scheduler
+ * void flush() - writes everything buffered right now
+ * void close() - flushes and closes the file
+ */
+class RunLog : public Task
+{
+public:
+    // Number of this run's file, records logged, records dropped.
+    int runNumber;
+    unsigned long logged, dropped;
+
+    RunLog(Scheduler &sched)
+    {
+        scheduler = &sched;
+        file = NULL;
+        runNumber = -1;
+        logged = 0;
+        dropped = 0;
+        unreported = 0;
+        head = 0;
+        count = 0;
+    }
+
+    /**
+     * @brief Opens a new log file for this run and starts flushing to it in the background.
+     */
+    void open()
+    {
+        runNumber = 0;
+        FEHFile *counter = SD.FOpen("runnum.txt", "r");
+        if (counter != NULL)
+        {
+            if (SD.FScanf(counter, "%d", &runNumber) != 1)
+            {
+                runNumber = 0;
+            }
+            SD.FClose(counter);
+        }
+        counter = SD.FOpen("runnum.txt", "w");
+        if (counter != NULL)
+        {
+            SD.FPrintf(counter, "%d\n", runNumber + 1);
+            SD.FClose(counter);
+        }
+        char name[16];
+        sprintf(name, "run%03d.log", runNumber % 1000);
+        file = SD.FOpen(name, "w");
+        scheduler->start(this);
+    }
+
+    /**
+     * @brief Logs a record. Only copies it into RAM, safe to call from a control loop.
+     */
+    void add(int type, int arg = 0, float v0 = 0.0, float v1 = 0.0, float v2 = 0.0, float v3 = 0.0, float v4 = 0.0)
+    {
+        if (count >= LOG_CAPACITY)
+        {
+            dropped++;
+            unreported++;
+            return;
+        }
+        LogRecord &record = buffer[(head + count) % LOG_CAPACITY];
+        record.micros = MicrosNow();
+        record.type = type;
+        record.arg = arg;
+        record.v[0] = v0;
+        record.v[1] = v1;
+        record.v[2] = v2;
+        record.v[3] = v3;
+        record.v[4] = v4;
+        count++;
+        logged++;
+        if (unreported > 0 && count < LOG_CAPACITY)
+        {
+            int lost = unreported;
+            unreported = 0;
+            add(LOG_DROPPED, lost);
+        }
+    }
+
+    /**
+     * @brief Writes a few records to the card, but only while no control loop is running. Never finishes.
+     */
+    bool step()
+    {
+        if (file != NULL && count > 0 && scheduler->idle())
+        {
+            write(LOG_FLUSH_BATCH);
+        }
+        return false;
+    }
+
+    /**
+     * @brief Writes everything in the buffer to the card now. For the end of the run, not in the middle of a motion.
+     */
+    void flush()
+    {
+        if (file != NULL)
+        {
+            write(count);
+        }
+    }
+
+    /**
+     * @brief Flushes and closes the file and stops flushing in the background.
+     */
+    void close()
+    {
+        scheduler->cancel(this);
+        flush();
+        if (file != NULL)
+        {
+            SD.FClose(file);
+            file = NULL;
+        }
+    }
+
+private:
+    Scheduler *scheduler;
+    FEHFile *file;
+    // Ring buffer of records waiting to be written, oldest at head.
+    LogRecord buffer[LOG_CAPACITY];
+    int head, count;
+    // Dropped records not yet reported with a LOG_DROPPED record.
+    int unreported;
+
+    void write(int records)
+    {
+        char line[LOG_LINE_LENGTH + 1];
+        while (records > 0 && count > 0)
+        {
+            packRecord(buffer[head], line);
+            SD.FPrintf(file, "%s\n", line);
+            head = (head + 1) % LOG_CAPACITY;
+            count--;
+            records--;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <FEHServo.h>
+#include <FEHUtility.h>
+#include <math.h>
+
+/**
+ * @brief A piece of work that runs a little at a time, so that several can run at once.
+ *
+ * step() is called over and over by the Scheduler and must never block (no Sleep, no busy loops).
+ * It returns true once the task is finished, after which end() is called once.
+ */
+class Task
+{
+public:
+    // True while the task is on the scheduler's list.
+    bool running;
+    // True for control loops (drives, line following). Background work like logging holds off while one is running.
+    bool control;
+    Task()
+    {
+        running = false;
+        control = false;
+    }
+    virtual ~Task()
+    {
+    }
+    // Does one small slice of work. Return true when done.
+    virtual bool step() = 0;
+    // Called once when the task finishes or is cancelled.
+    virtual void end()
+    {
+    }
+};
+
+// Most tasks that will ever run at once. Chassis, line follower, three servos and a couple of waits, plus the
+// background ones (odometry, run log, telemetry, battery, display).
+#define MAX_TASKS 12
+
+/**
+ * @brief Cooperative run loop. Steps every running task in turn until each one reports it is done.
+ *
+ * The following functions are included in the Scheduler class:
+ * bool start(Task *task) - starts a task (restarts it if already running), false if there's no room for it
+ * void cancel(Task *task) - stops a task early
+ * void tick() - steps every running task once
+ * void waitFor(Task *task) - keeps ticking until a task finishes
+ * void waitAll() - keeps ticking until every task finishes
+ * void sleep(double seconds) - keeps ticking for a set amount of time. Use instead of Sleep() so background tasks keep going.
+ * void sleepUntil(double time) - keeps ticking until TimeNow() reaches a time
+ * bool idle() - true if no control loop is running
+ * void setDeadline(double time) - makes every wait give up at a set time, 0 for no deadline
+ * bool expired() - true once the deadline has passed
+ *
+ * The deadline is what keeps a stuck motion from eating the rest of the run: past it, waitFor() cancels the task
+ * it was waiting for and sleeps return straight away, so any blocking call built on them comes back.
+ */
+class Scheduler
+{
+public:
+    Task *tasks[MAX_TASKS];
+    int numTasks;
+    // Set while inside tick(), so a task that calls back into the scheduler can't recurse.
+    bool ticking;
+    // TimeNow() at which waits give up, 0 for none.
+    double deadline;
+    // Tasks start() had no room for.
+    int overflows;
+
+    Scheduler()
+    {
+        numTasks = 0;
+        ticking = false;
+        deadline = 0.0;
+        overflows = 0;
+    }
+
+    /**
+     * @brief Adds a task to the run list. A task that is already running is ended and started over.
+     *
+     * @return false if all MAX_TASKS slots are taken, in which case the task isn't running and never will be. Anything
+     * that has already set something going for it (the motors) has to stop it again.
+     */
+    bool start(Task *task)
+    {
+        if (task->running)
+        {
+            cancel(task);
+        }
+        if (numTasks >= MAX_TASKS)
+        {
+            overflows++;
+            return false;
+        }
+        tasks[numTasks++] = task;
+        task->running = true;
+        return true;
+    }
+
+    /**
+     * @brief Stops a running task without waiting for it to finish.
+     */
+    void cancel(Task *task)
+    {
+        for (int i = 0; i < numTasks; i++)
+        {
+            if (tasks[i] == task)
+            {
+                remove(i);
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Steps every running task once and ends the ones that finish.
+     */
+    void tick()
+    {
+        if (ticking)
+        {
+            return;
+        }
+        ticking = true;
+        int i = 0;
+        while (i < numTasks)
+        {
+            if (tasks[i]->step())
+            {
+                remove(i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+        ticking = false;
+    }
+
+    /**
+     * @brief Keeps every task going until the given task finishes. Cancels it if the deadline passes first.
+     */
+    void waitFor(Task *task)
+    {
+        while (task->running)
+        {
+            if (expired())
+            {
+                cancel(task);
+                return;
+            }
+            tick();
+        }
+    }
+
+    /**
+     * @brief Keeps every task going until all of them finish.
+     */
+    void waitAll()
+    {
+        while (numTasks > 0)
+        {
+            tick();
+        }
+    }
+
+    /**
+     * @brief Replacement for Sleep() that keeps background tasks running while waiting.
+     *
+     * @param seconds Time to wait in seconds
+     */
+    void sleep(double seconds)
+    {
+        sleepUntil(TimeNow() + seconds);
+    }
+
+    /**
+     * @brief Keeps background tasks running until TimeNow() reaches a set time.
+     *
+     * @param time The TimeNow() value to wait for
+     */
+    void sleepUntil(double time)
+    {
+        while (TimeNow() < time && !expired())
+        {
+            tick();
+        }
+    }
+
+    /**
+     * @brief True if no control loop is running, so slow background work (SD writes) won't hold anything up.
+     */
+    bool idle()
+    {
+        for (int i = 0; i < numTasks; i++)
+        {
+            if (tasks[i]->control)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void setDeadline(double time)
+    {
+        deadline = time;
+    }
+
+    bool expired()
+    {
+        return deadline > 0.0 && TimeNow() >= deadline;
+    }
+
+private:
+    void remove(int index)
+    {
+        Task *task = tasks[index];
+        for (int i = index; i < numTasks - 1; i++)
+        {
+            tasks[i] = tasks[i + 1];
+        }
+        numTasks--;
+        task->running = false;
+        task->end();
+    }
+};
+
+/**
+ * @brief A wait that runs as a task, for waiting alongside other tasks with Scheduler::waitAll().
+ */
+class Wait : public Task
+{
+public:
+    Scheduler *scheduler;
+    double doneTime;
+    Wait(Scheduler &sched)
+    {
+        scheduler = &sched;
+        doneTime = 0.0;
+    }
+    /**
+     * @brief Starts waiting for a set amount of time.
+     */
+    void start(double seconds)
+    {
+        doneTime = TimeNow() + seconds;
+        scheduler->start(this);
+    }
+    bool step()
+    {
+        return TimeNow() >= doneTime;
+    }
+};
+
+// Seconds it takes a servo to swing one degree (about 0.23 s per 60 degrees), and time for it to settle once there.
+#define SERVO_SEC_PER_DEG 0.004
+#define SERVO_SETTLE 0.1
+
+/**
+ * @brief Servo move that runs as a task. SetDegree() doesn't block, so all this does is know when the
+ * servo will have arrived (estimated from how far it has to swing) and optionally hold it there a while.
+ */
+class ServoMove : public Task
+{
+public:
+    FEHServo *servo;
+    Scheduler *scheduler;
+    // Last commanded angle, or -1 if the servo has not been commanded yet.
+    float angle;
+    double doneTime;
+
+    ServoMove(FEHServo &s, Scheduler &sched)
+    {
+        servo = &s;
+        scheduler = &sched;
+        angle = -1.0;
+        doneTime = 0.0;
+    }
+    /**
+     * @brief Commands the servo and starts a task that finishes once it has arrived.
+     *
+     * @param degree Target angle in degrees
+     * @param hold Optional. Extra time to hold the servo at the target before the task finishes.
+     */
+    void moveTo(float degree, double hold = 0.0)
+    {
+        // Unknown start position, assume the worst case full swing.
+        float swing = angle < 0.0 ? 180.0 : fabs(degree - angle);
+        servo->SetDegree(degree);
+        angle = degree;
+        doneTime = TimeNow() + swing * SERVO_SEC_PER_DEG + SERVO_SETTLE + hold;
+        scheduler->start(this);
+    }
+    /**
+     * @brief Commands the servo without a task, for setting starting positions.
+     */
+    void set(float degree)
+    {
+        servo->SetDegree(degree);
+        angle = degree;
+    }
+    bool step()
+    {
+        return TimeNow() >= doneTime;
+    }
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef STARTLIGHT_H
+#define STARTLIGHT_H
+
+#include <FEHIO.h>
+
+#include "logRecords.h"
+#include "microClock.h"
+#include "runLog.h"
+#include "scheduler.h"
+
+// Time (us) spent averaging the CdS cell in the dark before watching for the light.
+#define START_LIGHT_BASELINE_US 200000
+// The light is on once the cell reads this many volts under the ambient baseline. The start light takes it from
+// about 2.9 V down to about 0.6 V, room light flicker and ADC noise are a few hundredths.
+#define START_LIGHT_DROP 0.6
+// Under this (volts) counts as lit whatever the baseline is, the threshold the robot always started on. Catches a
+// light that was already on when the baseline was taken, and one that comes up so slowly the baseline follows it.
+#define START_LIGHT_LIT_VOLTS 1.3
+// It has to stay that far down this long (us) before it counts, so a shadow or a bad conversion can't start the run.
+#define START_LIGHT_HOLD_US 3000
+// The rest of the tasks get a scheduler pass this often (us) while waiting. In between, the cell is read flat out.
+#define START_LIGHT_TICK_US 20000
+// How much of each reading (one per tick) goes into the baseline while it's dark, so it follows the room slowly.
+#define START_LIGHT_BASELINE_FILTER 0.02
+
+/**
+ * @brief Waits for the start light as fast as the CdS cell can be read, and measures how long the robot takes to
+ * react to it.
+ *
+ * wait() takes an ambient baseline with the light off, then reads the cell back to back and triggers when it has
+ * stayed START_LIGHT_DROP under the baseline, or under START_LIGHT_LIT_VOLTS, for START_LIGHT_HOLD_US. The edge is
+ * the first reading of that stretch, so the hold time shows up in the latency instead of being hidden. Dips shorter
+ * than the hold are counted as glitches and otherwise ignored. A baseline that's already under START_LIGHT_LIT_VOLTS
+ * was taken with the light on, so it's thrown out and the fixed threshold does the triggering. The scheduler only
+ * gets a pass every START_LIGHT_TICK_US, so background tasks keep going without slowing the reads down. Flush the
+ * run log first so a pass never has SD writes to do.
+ *
+ * motorCommand() goes in setDrive(). The first command that turns a wheel after the light logs a LOG_START_LIGHT
+ * record with the time from the edge to the trigger and to that first command, in microseconds.
+ *
+ * The following functions are included in the StartLight class:
+ * void wait() - blocks until the start light comes on
+ * void motorCommand(float leftPercent, float rightPercent) - notes the first motor command after the light
+ */
+class StartLight
+{
+public:
+    // Ambient voltage (0 if the light was already on when wait() started), average voltage while lit.
+    float baseline, litVolts;
+    // Readings taken while waiting, dips that didn't last.
+    unsigned long samples, glitches;
+    // First lit reading, when wait() returned, first motor command after that (MicrosNow()).
+    unsigned long edgeMicros, detectMicros, moveMicros;
+    // Set once wait() has returned, and once the first motor command after it has been logged.
+    bool detected, moved;
+
+    StartLight(AnalogInputPin &pin, Scheduler &sched, RunLog &log)
+    {
+        cds = &pin;
+        scheduler = &sched;
+        runLog = &log;
+        baseline = 0.0;
+        litVolts = 0.0;
+        samples = 0;
+        glitches = 0;
+        edgeMicros = 0;
+        detectMicros = 0;
+        moveMicros = 0;
+        detected = false;
+        moved = false;
+    }
+
+    /**
+     * @brief Takes the ambient baseline, then blocks until the light has been on for START_LIGHT_HOLD_US.
+     */
+    void wait()
+    {
+        unsigned long start = MicrosNow();
+        float sum = 0.0;
+        int count = 0;
+        while (count == 0 || MicrosNow() - start < START_LIGHT_BASELINE_US)
+        {
+            sum += cds->Value();
+            count++;
+        }
+        baseline = sum / count;
+        // Already lit, so that's no ambient. Go on the fixed threshold alone, and leave baseline 0 so nothing else
+        // takes it for the room (see CdsClassifier::setAmbient()).
+        if (baseline < START_LIGHT_LIT_VOLTS)
+        {
+            baseline = 0.0;
+        }
+
+        unsigned long lastTick = MicrosNow();
+        float litSum = 0.0;
+        int litCount = 0;
+        bool lit = false;
+        while (true)
+        {
+            float volts = cds->Value();
+            unsigned long now = MicrosNow();
+            samples++;
+            if (volts < baseline - START_LIGHT_DROP || volts < START_LIGHT_LIT_VOLTS)
+            {
+                if (!lit)
+                {
+                    lit = true;
+                    edgeMicros = now;
+                    litSum = 0.0;
+                    litCount = 0;
+                }
+                litSum += volts;
+                litCount++;
+                if (now - edgeMicros >= START_LIGHT_HOLD_US)
+                {
+                    break;
+                }
+            }
+            else if (lit)
+            {
+                lit = false;
+                glitches++;
+            }
+            if (!lit && now - lastTick >= START_LIGHT_TICK_US)
+            {
+                if (baseline > 0.0)
+                {
+                    baseline += START_LIGHT_BASELINE_FILTER * (volts - baseline);
+                }
+                scheduler->tick();
+                lastTick = MicrosNow();
+            }
+        }
+        detectMicros = MicrosNow();
+        litVolts = litSum / litCount;
+        detected = true;
+    }
+
+    /**
+     * @brief Call with every drive command. Logs the reaction time on the first one that turns a wheel after the light.
+     */
+    void motorCommand(float leftPercent, float rightPercent)
+    {
+        if (!detected || moved || (leftPercent == 0.0 && rightPercent == 0.0))
+        {
+            return;
+        }
+        moved = true;
+        moveMicros = MicrosNow();
+        runLog->add(LOG_START_LIGHT, glitches, baseline, litVolts, detectMicros - edgeMicros, moveMicros - edgeMicros,
+                    samples);
+    }
+
+private:
+    AnalogInputPin *cds;
+    Scheduler *scheduler;
+    RunLog *runLog;
+};
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <FEHSD.h>
+#include <stdio.h>
+
+#include "encoders.h"
+#include "logRecords.h"
+#include "loopTimer.h"
+#include "rpsCache.h"
+#include "scheduler.h"
+
+// Sampling period while a primitive is running (100 Hz).
+#define TELEMETRY_PERIOD_US 10000
+// Samples kept in RAM (20 bytes each, 30 KB). 15 seconds of driving at 100 Hz, the buffer is emptied whenever
+// the robot stops between primitives so this only has to hold the longest stretch of back to back motions.
+#define TELEMETRY_SAMPLES 1536
+// Most samples written per scheduler pass while idle.
+#define TELEMETRY_FLUSH_BATCH 4
+
+/**
+ * @brief One telemetry sample. Positions are in hundredths of an inch and the heading in tenths of a degree so
+ * a sample stays small. RPS -1/-2 come out as -100/-200.
+ */
+struct TelemetrySample
+{
+    unsigned long micros;
+    short leftCounts, rightCounts;
+    short x, y, heading;
+    signed char leftCommand, rightCommand;
+    // Segment (primitive run) this sample belongs to and what kind of primitive it was.
+    unsigned char segment, primitive;
+};
+
+/**
+ * @brief Records encoder counts, motor commands and the RPS pose at 100 Hz during every primitive, in RAM.
+ *
+ * Each primitive is one segment: beginSegment() when it starts, endSegment() when it's done. Sampling is just
+ * copying a few numbers into the buffer. The samples go to the card (tlmNNN.txt, same number as the run log) in
+ * the background once no control loop is running, or all at once by close() at the end of the run. If the buffer
+ * fills up, sampling stops until it's been written out and the missed samples are counted in dropped.
+ *
+ * Each line on the card is: segment primitive micros leftCounts rightCounts leftCommand rightCommand x y heading.
+ * Simulation/telemetryCsv splits a file into one CSV per segment.
+ *
+ * The following functions are included in the Telemetry class:
+ * void open(int run) - opens tlmNNN.txt and starts the task
+ * void beginSegment(int primitive) - starts recording a primitive (a Motion mode or LOG_PRIMITIVE_FOLLOW)
+ * void endSegment() - stops recording
+ * bool step() - samples while recording, writes to the card while idle. Called by the scheduler.
+ * void close() - writes whatever is left and closes the file
+ */
+class Telemetry : public Task
+{
+public:
+    // Last motor percents commanded, kept up to date by whoever drives the motors.
+    float leftCommand, rightCommand;
+    // Segments started, samples taken, samples missed because the buffer was full.
+    int segments;
+    unsigned long samples, dropped;
+
+    Telemetry(Encoder &left, Encoder &right, RpsCache &rpsCache, Scheduler &sched)
+    {
+        leftEncoder = &left;
+        rightEncoder = &right;
+        rps = &rpsCache;
+        scheduler = &sched;
+        file = NULL;
+        leftCommand = 0.0;
+        rightCommand = 0.0;
+        segments = 0;
+        samples = 0;
+        dropped = 0;
+        count = 0;
+        written = 0;
+        recording = false;
+        primitive = 0;
+    }
+
+    /**
+     * @brief Opens the telemetry file for a run and starts the background task.
+     *
+     * @param run Run number, so the file matches the run log
+     */
+    void open(int run)
+    {
+        char name[16];
+        sprintf(name, "tlm%03d.txt", run % 1000);
+        file = SD.FOpen(name, "w");
+        scheduler->start(this);
+    }
+
+    /**
+     * @brief Starts recording a new segment. Call after the primitive has zeroed the encoder counts.
+     */
+    void beginSegment(int newPrimitive)
+    {
+        primitive = newPrimitive;
+        recording = true;
+        timer.start(TELEMETRY_PERIOD_US);
+        // Segment numbers go in a byte on each sample, they wrap after 256 which the export doesn't mind.
+        segments++;
+    }
+
+    /**
+     * @brief Stops recording, with one last sample so the segment ends where the primitive did.
+     */
+    void endSegment()
+    {
+        if (recording)
+        {
+            sample();
+        }
+        recording = false;
+    }
+
+    bool step()
+    {
+        if (recording)
+        {
+            if (timer.due())
+            {
+                sample();
+                timer.done();
+            }
+        }
+        else if (file != NULL && written < count && scheduler->idle())
+        {
+            write(TELEMETRY_FLUSH_BATCH);
+        }
+        // Runs for the whole run.
+        return false;
+    }
+
+    /**
+     * @brief Writes out everything still in RAM and closes the file.
+     */
+    void close()
+    {
+        scheduler->cancel(this);
+        recording = false;
+        if (file != NULL)
+        {
+            write(count);
+            SD.FClose(file);
+            file = NULL;
+        }
+    }
+
+private:
+    Encoder *leftEncoder, *rightEncoder;
+    RpsCache *rps;
+    Scheduler *scheduler;
+    FEHFile *file;
+    LoopTimer timer;
+    TelemetrySample buffer[TELEMETRY_SAMPLES];
+    // Samples in the buffer, and how many of those are on the card already.
+    int count, written;
+    bool recording;
+    int primitive;
+
+    void sample()
+    {
+        if (count >= TELEMETRY_SAMPLES)
+        {
+            dropped++;
+            return;
+        }
+        TelemetrySample &s = buffer[count++];
+        s.micros = MicrosNow();
+        s.leftCounts = leftEncoder->Counts();
+        s.rightCounts = rightEncoder->Counts();
+        s.x = (short)(rps->sample.x * 100.0);
+        s.y = (short)(rps->sample.y * 100.0);
+        s.heading = (short)(rps->sample.heading * 10.0);
+        s.leftCommand = (signed char)leftCommand;
+        s.rightCommand = (signed char)rightCommand;
+        s.segment = (unsigned char)segments;
+        s.primitive = (unsigned char)primitive;
+        samples++;
+    }
+
+    void write(int lines)
+    {
+        while (lines > 0 && written < count)
+        {
+            TelemetrySample &s = buffer[written++];
+            SD.FPrintf(file, "%d %d %lu %d %d %d %d %d %d %d\n", s.segment, s.primitive, s.micros, s.leftCounts,
+                       s.rightCounts, s.leftCommand, s.rightCommand, s.x, s.y, s.heading);
+            lines--;
+        }
+        // All on the card and nothing recording, start the buffer over.
+        if (written >= count && !recording)
+        {
+            count = 0;
+            written = 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef VELOCITYPID_H
+#define VELOCITYPID_H
+
+// Default wheel velocity gains. Error is in ticks/s, output is motor percent.
+#define WHEEL_KP 0.6
+#define WHEEL_KI 6.0
+#define WHEEL_KD 0.0
+// Most the integral term may add or take away, in motor percent.
+#define WHEEL_I_LIMIT 20.0
+
+/**
+ * @brief PID controller for the speed of one wheel.
+ *
+ * Output = feedForward * target + kp * error + ki * integral(error) + kd * d(error)/dt, in motor percent.
+ * The feed forward gets the motor close to the right speed straight away (it comes from the equilibrium
+ * percentages), so the PID part only has to clean up what's left and settles in a few ticks.
+ *
+ * Integral windup protection: the integral is clamped to +/- integralLimit, it stops growing while the output
+ * is saturated, and it doesn't start growing until the wheel is actually measured turning (right after
+ * SetPercent the encoder hasn't ticked yet, which would otherwise read as a huge error).
+ *
+ * The following functions are included in the VelocityPID class:
+ * void setGains(float p, float i, float d) - changes the gains
+ * void reset(float ff) - clears the state, call at the start of every motion
+ * float update(float target, float measured, float dt) - returns the new motor percent (magnitude, 0 to 100)
+ */
+class VelocityPID
+{
+public:
+    float kp, ki, kd, integralLimit;
+    // Motor percent per tick/s, applied to the target directly.
+    float feedForward;
+    float integral, lastError, output;
+
+    VelocityPID()
+    {
+        setGains(WHEEL_KP, WHEEL_KI, WHEEL_KD);
+        integralLimit = WHEEL_I_LIMIT;
+        reset(0.0);
+    }
+
+    /**
+     * @brief Changes the PID gains.
+     */
+    void setGains(float p, float i, float d)
+    {
+        kp = p;
+        ki = i;
+        kd = d;
+    }
+
+    /**
+     * @brief Clears the integral and derivative history.
+     *
+     * @param ff Feed forward in motor percent per tick/s
+     */
+    void reset(float ff)
+    {
+        feedForward = ff;
+        integral = 0.0;
+        lastError = 0.0;
+        output = 0.0;
+    }
+
+    /**
+     * @brief One controller update.
+     *
+     * @param target Wanted wheel speed in ticks/s
+     * @param measured Measured wheel speed in ticks/s
+     * @param dt Time since the last update in seconds
+     * @return Motor percent magnitude, 0 to 100
+     */
+    float update(float target, float measured, float dt)
+    {
+        float error = target - measured;
+        float derivative = dt > 0.0 ? (error - lastError) / dt : 0.0;
+        lastError = error;
+
+        float unclamped = feedForward * target + kp * error + ki * integral + kd * derivative;
+        bool saturatedHigh = unclamped >= 100.0 && error > 0.0;
+        bool saturatedLow = unclamped <= 0.0 && error < 0.0;
+        if (measured > 0.0 && !saturatedHigh && !saturatedLow)
+        {
+            integral += error * dt;
+            if (ki > 0.0 && ki * integral > integralLimit)
+            {
+                integral = integralLimit / ki;
+            }
+            else if (ki > 0.0 && ki * integral < -integralLimit)
+            {
+                integral = -integralLimit / ki;
+            }
+        }
+
+        output = feedForward * target + kp * error + ki * integral + kd * derivative;
+        if (output > 100.0)
+        {
+            output = 100.0;
+        }
+        else if (output < 0.0)
+        {
+            output = 0.0;
+        }
+        return output;
+    }
+};
+
+#endif
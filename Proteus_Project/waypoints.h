@@ -0,0 +1,237 @@
+#ifndef WAYPOINTS_H
+#define WAYPOINTS_H
+
+#include <FEHSD.h>
+#include <stdio.h>
+#include <string.h>
+
+// Waypoint IDs, indexes into WaypointTable. Waypoint files go by name (waypointName()), so new ones can go anywhere.
+#define WP_JUKEBOX_LED 0
+#define WP_TRASH 1
+#define WP_RED_BUTTON 2
+#define WP_BLUE_BUTTON 3
+#define WP_RAMP_BOTTOM 4
+#define WP_RAMP_TOP 5
+#define WP_GRILL 6
+// x only
+#define WP_GRILL_LANE 7
+// x only
+#define WP_TOP_RIGHT_WALL 8
+#define WP_TOP_CENTER 9
+// Heading is 135 degrees for levers
+#define WP_VANILLA_LEVER 10
+#define WP_TWIST_LEVER 11
+#define WP_CHOCOLATE_LEVER 12
+#define WP_VANILLA_ACTUAL 13
+#define WP_TWIST_ACTUAL 14
+#define WP_CHOCOLATE_ACTUAL 15
+#define WP_DOWN_RAMP_TOP 16
+#define WP_DOWN_RAMP_BOTTOM 17
+#define WP_BOTTOM_WALL 18
+#define WP_BOTTOM_RIGHT_WALL 19
+#define WP_TICKET_SLIDER 20
+#define WP_STOP_BUTTON 21
+#define NUM_WAYPOINTS 22
+
+// Most characters in a name in a waypoint file.
+#define WAYPOINT_NAME_LENGTH 23
+
+/**
+ * @brief Name of a waypoint in waypoint files, or NULL for an ID that doesn't exist.
+ */
+inline const char *waypointName(int id)
+{
+    static const char *names[NUM_WAYPOINTS] = {
+        "jukebox", "trash", "red_button", "blue_button", "ramp_bottom", "ramp_top", "grill", "grill_lane",
+        "top_right_wall", "top_center", "vanilla_lever", "twist_lever", "chocolate_lever", "vanilla_actual",
+        "twist_actual", "chocolate_actual", "down_ramp_top", "down_ramp_bottom", "bottom_wall", "bottom_right_wall",
+        "ticket_slider", "stop_button"};
+    return id >= 0 && id < NUM_WAYPOINTS ? names[id] : NULL;
+}
+
+/**
+ * @brief Course coordinates the run drives to, by waypoint ID, in RPS inches.
+ *
+ * Starts out with the built in defaults (measured on course 1). load() reads the course's waypoint file off the SD
+ * card, wpN.txt for course N, over the top of them, so a point can be retuned without a rebuild. Each line of the
+ * file is a name and two numbers:
+ *
+ *     jukebox 8.2 22.0
+ *     offsetB 0.3 -0.2
+ *
+ * A waypoint name sets that point. "offset" and a region letter shifts every point by that much when running in
+ * that region, for regions whose RPS doesn't quite line up with the one the file was measured in. Names it doesn't
+ * know are skipped, and anything the file doesn't mention keeps its default.
+ *
+ * Points captured on the course with RPS (Waypoints::logCoordinates()) are saved in the same format, and read back
+ * as measured in the region they were captured in, so the offset isn't added to them again.
+ *
+ * The following functions are included in the WaypointTable class:
+ * void defaults() - back to the built in coordinates, no offset
+ * int load(int course, char region) - reads the course's file, returns how many points it set
+ * int read(const char *fileName, bool measuredHere) - reads points from any waypoint file
+ * bool save(const char *fileName, const int *ids, int count) - writes some points to a waypoint file
+ * float x(int id), float y(int id) - a waypoint's coordinates, offset for the region
+ * void set(int id, float x, float y) - sets a waypoint measured in the current region
+ * int find(const char *name) - ID of a waypoint name, -1 if there's no such waypoint
+ */
+class WaypointTable
+{
+public:
+    float pointX[NUM_WAYPOINTS], pointY[NUM_WAYPOINTS];
+    // Shift for the region being run in.
+    float offsetX, offsetY;
+    int course;
+    char region;
+
+    WaypointTable()
+    {
+        course = 0;
+        region = 'A';
+        defaults();
+    }
+
+    void defaults()
+    {
+        static const float builtIn[NUM_WAYPOINTS][2] = {
+            {8.2, 22.0},   // jukebox
+            {6.8, 24.0},   // trash
+            {7.0, 15.8},   // red_button
+            {9.3, 15.8},   // blue_button
+            {15.4, 20.2},  // ramp_bottom
+            {17.3, 47.9},  // ramp_top
+            {30.8, 61.4},  // grill
+            {31.6, 0.0},   // grill_lane
+            {28.6, 0.0},   // top_right_wall
+            {27.4, 45.7},  // top_center
+            {14.9, 49.5},  // vanilla_lever
+            {18.2, 52.5},  // twist_lever
+            {21.5, 55.5},  // chocolate_lever
+            {6.2, 57.5},   // vanilla_actual
+            {9.5, 60.5},   // twist_actual
+            {12.8, 63.5},  // chocolate_actual
+            {17.6, 43.5},  // down_ramp_top
+            {18.3, 20.6},  // down_ramp_bottom
+            {28.7, 20.5},  // bottom_wall
+            {31.0, 20.0},  // bottom_right_wall
+            {30.8, 42.7},  // ticket_slider
+            {28.7, 8.5}};  // stop_button
+        for (int i = 0; i < NUM_WAYPOINTS; i++)
+        {
+            pointX[i] = builtIn[i][0];
+            pointY[i] = builtIn[i][1];
+        }
+        offsetX = 0.0;
+        offsetY = 0.0;
+    }
+
+    /**
+     * @brief Reads wpN.txt for the course over the defaults, and picks up the offset for the region.
+     *
+     * @return Waypoints the file set, 0 if there is no file
+     */
+    int load(int courseNumber, char regionLetter)
+    {
+        course = courseNumber;
+        region = regionLetter;
+        char fileName[16];
+        sprintf(fileName, "wp%d.txt", course);
+        return read(fileName, false);
+    }
+
+    /**
+     * @brief Reads a waypoint file over the current points.
+     *
+     * @param measuredHere true if the coordinates were measured in this region (set() them), false if they're
+     *      the course's own and get the region offset (the offset lines only count then)
+     * @return Waypoints the file set, 0 if there is no file
+     */
+    int read(const char *fileName, bool measuredHere)
+    {
+        FEHFile *file = SD.FOpen(fileName, "r");
+        if (file == NULL)
+        {
+            return 0;
+        }
+        int count = 0;
+        char name[WAYPOINT_NAME_LENGTH + 1];
+        float x, y;
+        while (SD.FScanf(file, "%23s%f%f", name, &x, &y) == 3)
+        {
+            if (strncmp(name, "offset", 6) == 0)
+            {
+                if (!measuredHere && name[6] == region && name[7] == '\0')
+                {
+                    offsetX = x;
+                    offsetY = y;
+                }
+                continue;
+            }
+            int id = find(name);
+            if (id >= 0 && measuredHere)
+            {
+                set(id, x, y);
+                count++;
+            }
+            else if (id >= 0)
+            {
+                pointX[id] = x;
+                pointY[id] = y;
+                count++;
+            }
+        }
+        SD.FClose(file);
+        return count;
+    }
+
+    /**
+     * @brief Writes points as they are here (offset included), in a file read() can take back.
+     */
+    bool save(const char *fileName, const int *ids, int count)
+    {
+        FEHFile *file = SD.FOpen(fileName, "w");
+        if (file == NULL)
+        {
+            return false;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            SD.FPrintf(file, "%s %f %f\n", waypointName(ids[i]), x(ids[i]), y(ids[i]));
+        }
+        SD.FClose(file);
+        return true;
+    }
+
+    float x(int id)
+    {
+        return pointX[id] + offsetX;
+    }
+
+    float y(int id)
+    {
+        return pointY[id] + offsetY;
+    }
+
+    /**
+     * @brief Sets a waypoint from where RPS says it is here, so x() and y() give exactly that back.
+     */
+    void set(int id, float newX, float newY)
+    {
+        pointX[id] = newX - offsetX;
+        pointY[id] = newY - offsetY;
+    }
+
+    int find(const char *name)
+    {
+        for (int i = 0; i < NUM_WAYPOINTS; i++)
+        {
+            if (strcmp(name, waypointName(i)) == 0)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+};
+
+#endif
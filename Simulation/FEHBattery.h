@@ -0,0 +1,13 @@
+#ifndef FEHBATTERY_H
+#define FEHBATTERY_H
+
+// Host stand-in for the Proteus firmware's FEHBattery.h. Reads the simulated battery voltage.
+class FEHBattery
+{
+public:
+    float Voltage();
+};
+
+extern FEHBattery Battery;
+
+#endif
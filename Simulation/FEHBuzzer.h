@@ -0,0 +1,16 @@
+#ifndef FEHBUZZER_H
+#define FEHBUZZER_H
+
+// Host stand-in for the Proteus firmware's FEHBuzzer.h. Silent.
+class FEHBuzzer
+{
+public:
+    void Beep();
+    void Buzz(int duration);
+    void Tone(int frequency, int duration);
+    void Off();
+};
+
+extern FEHBuzzer Buzzer;
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef FEHIO_H
+#define FEHIO_H
+
+#include <vector>
+
+/*
+    Host stand-in for the Proteus firmware's FEHIO.h.
+    Every pin reads from the SimPins table below, so a test harness can replay recorded
+    edge sequences into the digital pins and set analog voltages without touching robot code.
+*/
+class FEHIO
+{
+public:
+    typedef enum
+    {
+        P0_0 = 0, P0_1, P0_2, P0_3, P0_4, P0_5, P0_6, P0_7,
+        P1_0, P1_1, P1_2, P1_3, P1_4, P1_5, P1_6, P1_7,
+        P2_0, P2_1, P2_2, P2_3, P2_4, P2_5, P2_6, P2_7,
+        P3_0, P3_1, P3_2, P3_3, P3_4, P3_5, P3_6, P3_7,
+        NUM_PINS
+    } FEHIOPin;
+
+    typedef enum
+    {
+        RisingEdge = 0x09,
+        FallingEdge = 0x0A,
+        EitherEdge = 0x0B
+    } FEHIOInterruptTrigger;
+};
+
+/**
+ * @brief Edge sequence replayed into one simulated digital pin.
+ *
+ * Edges are simulated-clock timestamps in microseconds, kept sorted. The pin level at time t is
+ * the initial level toggled once for every edge at or before t.
+ */
+class EdgeTrace
+{
+public:
+    bool initialLevel;
+    std::vector<unsigned long long> edges;
+    EdgeTrace();
+    void clear(bool level = false);
+    void addEdge(unsigned long long micros);
+    // Level of the pin at a given time.
+    bool levelAt(unsigned long long micros);
+    // Number of edges in (fromMicros, toMicros] that match the trigger.
+    int edgesBetween(unsigned long long fromMicros, unsigned long long toMicros, FEHIO::FEHIOInterruptTrigger trigger);
+    // Loads one edge timestamp (microseconds) per line. Returns false if the file could not be read.
+    bool load(const char *fileName);
+};
+
+namespace SimPins
+{
+    extern EdgeTrace digital[FEHIO::NUM_PINS];
+    extern float analog[FEHIO::NUM_PINS];
+    // Cost in microseconds of a single digital or analog pin read.
+    extern unsigned long digitalReadCost, analogReadCost;
+    void reset();
+}
+
+class DigitalInputPin
+{
+public:
+    DigitalInputPin(FEHIO::FEHIOPin pin);
+    bool Value();
+
+private:
+    FEHIO::FEHIOPin pin;
+};
+
+/**
+ * @brief Stand-in for the firmware's interrupt counted encoder. Counts are taken straight from the
+ * replayed edge trace, so they are exact no matter how rarely the robot code looks at them,
+ * just like the port interrupt on the Proteus.
+ */
+class DigitalEncoder
+{
+public:
+    DigitalEncoder(FEHIO::FEHIOPin pin, FEHIO::FEHIOInterruptTrigger trigger = FEHIO::EitherEdge);
+    int Counts();
+    void ResetCounts();
+
+private:
+    FEHIO::FEHIOPin pin;
+    FEHIO::FEHIOInterruptTrigger trigger;
+    unsigned long long resetMicros;
+};
+
+class AnalogInputPin
+{
+public:
+    AnalogInputPin(FEHIO::FEHIOPin pin);
+    float Value();
+
+private:
+    FEHIO::FEHIOPin pin;
+};
+
+#endif
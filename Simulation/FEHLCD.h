@@ -0,0 +1,72 @@
+#ifndef FEHLCD_H
+#define FEHLCD_H
+
+#include <FEHUtility.h>
+#include <LCDColors.h>
+
+/*
+    Host stand-in for the Proteus firmware's FEHLCD.h.
+    Nothing is drawn. Every call costs simulated time roughly what it costs on the real screen, and the last line
+    of text written is kept so a simulated operator can react to prompts. Touch() alternates between pressed and
+    released, so the robot's "wait for a tap" loops get a tap straight away, at touchX, touchY.
+*/
+namespace SimLcd
+{
+    // Last string written with Write() or WriteLine().
+    extern char lastLine[128];
+    // Calls and simulated microseconds spent drawing, since the last reset.
+    extern unsigned long calls;
+    extern unsigned long long drawMicros;
+    // Cost in microseconds of clearing the screen, writing a line of text and filling a shape.
+    extern unsigned long clearCost, textCost, fillCost;
+    // Called with lastLine whenever text is written, so a simulated operator can answer prompts. May be NULL.
+    extern void (*onText)(const char *line);
+    // Where on the screen the operator taps.
+    extern float touchX, touchY;
+    void reset();
+}
+
+class FEHLCD
+{
+public:
+    void Clear();
+    void Clear(unsigned int color);
+    void SetBackgroundColor(unsigned int color);
+    void SetFontColor(unsigned int color);
+
+    void WriteLine(const char *str);
+    void WriteLine(int i);
+    void WriteLine(float f);
+    void WriteLine(double d);
+    void WriteLine(bool b);
+    void WriteLine(char c);
+    void Write(const char *str);
+    void Write(int i);
+    void Write(float f);
+    void Write(double d);
+    void Write(bool b);
+    void Write(char c);
+    void WriteAt(const char *str, int x, int y);
+    void WriteAt(int i, int x, int y);
+    void WriteAt(float f, int x, int y);
+    void WriteAt(double d, int x, int y);
+    void WriteRC(const char *str, int row, int col);
+    void WriteRC(int i, int row, int col);
+    void WriteRC(float f, int row, int col);
+
+    void FillRectangle(int x, int y, int width, int height);
+    void DrawRectangle(int x, int y, int width, int height);
+    void FillCircle(int x, int y, int r);
+    void DrawCircle(int x, int y, int r);
+    void DrawPixel(int x, int y);
+    void DrawHorizontalLine(int y, int x1, int x2);
+    void DrawVerticalLine(int x, int y1, int y2);
+
+    bool Touch(float *x, float *y);
+    bool Touch(int *x, int *y);
+    void ClearBuffer();
+};
+
+extern FEHLCD LCD;
+
+#endif
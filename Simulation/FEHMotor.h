@@ -0,0 +1,27 @@
+#ifndef FEHMOTOR_H
+#define FEHMOTOR_H
+
+/*
+    Host stand-in for the Proteus firmware's FEHMotor.h. Commands go to the simulated world (simWorld.h).
+*/
+class FEHMotor
+{
+public:
+    typedef enum
+    {
+        Motor0 = 0,
+        Motor1,
+        Motor2,
+        Motor3
+    } FEHMotorPort;
+
+    FEHMotor(FEHMotorPort port, float maxVoltage);
+    void SetPercent(float percent);
+    void Stop();
+
+private:
+    FEHMotorPort port;
+    float maxVoltage;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef FEHRPS_H
+#define FEHRPS_H
+
+/*
+    Host stand-in for the Proteus firmware's FEHRPS.h. Frames come from the simulated world's RPS model
+    (noise, update rate and latency, see simWorld.h). -1 before InitializeTouchMenu() or during a dropout,
+    -2 in a deadzone.
+*/
+class FEHRPS
+{
+public:
+    void InitializeTouchMenu();
+    float X();
+    float Y();
+    float Heading();
+    int CurrentCourse();
+    char CurrentRegionLetter();
+    int CurrentRegion();
+    int GetIceCream();
+};
+
+extern FEHRPS RPS;
+
+#endif
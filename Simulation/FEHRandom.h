@@ -0,0 +1,14 @@
+#ifndef FEHRANDOM_H
+#define FEHRANDOM_H
+
+// Host stand-in for the Proteus firmware's FEHRandom.h.
+class FEHRandom
+{
+public:
+    void Seed();
+    int RandInt();
+};
+
+extern FEHRandom Random;
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef FEHSD_H
+#define FEHSD_H
+
+/*
+    Host stand-in for the Proteus firmware's FEHSD.h. Files live in SimSd::directory on the host. If the
+    directory is empty, writes go nowhere and reads find nothing (for batch runs that don't want the logs).
+*/
+struct FEHFile;
+
+namespace SimSd
+{
+    extern char directory[256];
+    // Cost in microseconds of one FPrintf/FScanf and of opening or closing a file.
+    extern unsigned long writeCost, openCost;
+}
+
+class FEHSD
+{
+public:
+    FEHFile *FOpen(const char *name, const char *mode);
+    int FClose(FEHFile *file);
+    int FCloseAll();
+    int FPrintf(FEHFile *file, const char *format, ...);
+    int FScanf(FEHFile *file, const char *format, ...);
+    int FEof(FEHFile *file);
+};
+
+extern FEHSD SD;
+
+#endif
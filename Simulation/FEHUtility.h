@@ -0,0 +1,31 @@
+#ifndef FEHUTILITY_H
+#define FEHUTILITY_H
+
+/*
+    Host stand-in for the Proteus firmware's FEHUtility.h.
+    Time is simulated: nothing here ever reads the wall clock. Every call that would
+    take time on the robot (a TimeNow() read, an ADC conversion, a Sleep) moves the
+    simulated clock forward instead, so busy loops written for the robot still terminate.
+*/
+namespace SimClock
+{
+    // Current simulated time in microseconds since power on.
+    extern unsigned long long nowMicros;
+    // Cost in microseconds charged to every TimeNow() call. Models the loop overhead of polling code.
+    extern unsigned long timeReadCost;
+    // Called after every advance, so a simulated world can catch up to the new time. NULL if nothing needs to.
+    extern void (*onAdvance)();
+    // Moves the simulated clock forward.
+    void advance(unsigned long long micros);
+    // Resets the clock to zero and the per call costs to their defaults. Leaves onAdvance alone.
+    void reset();
+}
+
+double TimeNow();
+unsigned int TimeNowSec();
+unsigned int TimeNowMSec();
+void Sleep(int msec);
+void Sleep(float sec);
+void Sleep(double sec);
+
+#endif
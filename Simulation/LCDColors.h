@@ -0,0 +1,14 @@
+#ifndef LCDCOLORS_H
+#define LCDCOLORS_H
+
+// Host stand-in for the Proteus firmware's LCDColors.h (24 bit RGB).
+#define BLACK 0x000000u
+#define WHITE 0xFFFFFFu
+#define RED 0xFF0000u
+#define GREEN 0x008000u
+#define BLUE 0x0000FFu
+#define GRAY 0x808080u
+#define SCARLET 0xFF2400u
+#define YELLOW 0xFFFF00u
+
+#endif
@@ -0,0 +1,149 @@
+/*
+    encoderReplay - measures pinwheel tick loss off the robot.
+
+    Replays the same edge sequence into a simulated encoder pin and counts it two ways:
+        1) the old busy-poll (compare DigitalInputPin.Value() to the last value every pass of the loop)
+        2) the interrupt driven Encoder from encoders.h
+    The loop body cost models everything else a motion loop does between looks at the pin, and every
+    0.4 s a longer stall models the speed correction block (RPS reads, SetPercent, LCD writes).
+
+    Usage:
+        ./encoderReplay [bodyMicros] [stallMicros] [glitchChance] [traceFile]
+    With a traceFile (one edge timestamp in microseconds per line) only that trace is replayed.
+    Without one, a sweep of wheel speeds is generated.
+*/
+#include <FEHUtility.h>
+#include <FEHIO.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "encoders.h"
+
+// Black/white transitions per wheel revolution, same as Motion motion(20) in main.cpp
+#define COUNTS_PER_REV 20
+#define REPLAY_SECONDS 2.0
+
+struct ReplayResult
+{
+    int trueTicks, polledTicks, encoderTicks, rejectedTicks;
+};
+
+/**
+ * @brief Fills the pin's trace with evenly spaced ticks for a wheel speed. Each tick has a
+ * glitchChance chance of being followed by a short bounce (two extra edges 20 and 40 us later).
+ *
+ * @return number of real ticks in the trace
+ */
+int generateTrace(EdgeTrace &trace, float revsPerSec, float glitchChance)
+{
+    trace.clear(false);
+    double period = 1000000.0 / (revsPerSec * COUNTS_PER_REV);
+    int ticks = 0;
+    for (double t = period; t < REPLAY_SECONDS * 1000000.0; t += period)
+    {
+        trace.addEdge((unsigned long long)t);
+        if (rand() < glitchChance * RAND_MAX)
+        {
+            trace.addEdge((unsigned long long)t + 20);
+            trace.addEdge((unsigned long long)t + 40);
+        }
+        ticks++;
+    }
+    return ticks;
+}
+
+/**
+ * @brief Runs the poll loop and the Encoder loop over whatever is in the P3_1 trace.
+ */
+ReplayResult replay(unsigned long bodyMicros, unsigned long stallMicros, unsigned long long endMicros)
+{
+    ReplayResult result;
+    DigitalInputPin pin(FEHIO::P3_1);
+
+    // 1) Old busy-poll from Motion::driveForward
+    SimClock::reset();
+    int current = pin.Value();
+    int polled = 0;
+    double intervalTime = TimeNow();
+    while (SimClock::nowMicros < endMicros)
+    {
+        if (current != pin.Value())
+        {
+            current = pin.Value();
+            polled++;
+        }
+        SimClock::advance(bodyMicros);
+        if (TimeNow() - intervalTime >= 0.40)
+        {
+            SimClock::advance(stallMicros);
+            intervalTime = TimeNow();
+        }
+    }
+    result.polledTicks = polled;
+
+    // 2) Interrupt counted Encoder, same loop body
+    SimClock::reset();
+    Encoder encoder(FEHIO::P3_1);
+    encoder.ResetCounts();
+    intervalTime = TimeNow();
+    while (SimClock::nowMicros < endMicros)
+    {
+        encoder.Update();
+        SimClock::advance(bodyMicros);
+        if (TimeNow() - intervalTime >= 0.40)
+        {
+            SimClock::advance(stallMicros);
+            intervalTime = TimeNow();
+        }
+    }
+    encoder.Update();
+    result.encoderTicks = encoder.Counts();
+    result.rejectedTicks = encoder.rejected;
+    return result;
+}
+
+void printRow(const char *label, ReplayResult r)
+{
+    printf("%-10s %8d %8d %7.1f%% %8d %7.1f%% %8d\n", label, r.trueTicks,
+           r.polledTicks, 100.0 * (r.trueTicks - r.polledTicks) / r.trueTicks,
+           r.encoderTicks, 100.0 * (r.trueTicks - r.encoderTicks) / r.trueTicks,
+           r.rejectedTicks);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long bodyMicros = argc > 1 ? strtoul(argv[1], NULL, 10) : 300;
+    unsigned long stallMicros = argc > 2 ? strtoul(argv[2], NULL, 10) : 30000;
+    float glitchChance = argc > 3 ? atof(argv[3]) : 0.0;
+    srand(1);
+
+    printf("loop body %lu us, stall %lu us every 0.4 s, glitch chance %.3f\n", bodyMicros, stallMicros, glitchChance);
+    printf("%-10s %8s %8s %8s %8s %8s %8s\n", "rev/s", "true", "polled", "lost", "encoder", "lost", "rejected");
+
+    if (argc > 4)
+    {
+        EdgeTrace &trace = SimPins::digital[FEHIO::P3_1];
+        trace.clear(false);
+        if (!trace.load(argv[4]) || trace.edges.empty())
+        {
+            printf("Could not read edges from %s\n", argv[4]);
+            return 1;
+        }
+        ReplayResult r = replay(bodyMicros, stallMicros, trace.edges.back() + 1);
+        r.trueTicks = trace.edges.size();
+        printRow("trace", r);
+        return 0;
+    }
+
+    float speeds[] = {0.5, 1.0, 2.0, 3.0, 4.0, 6.0, 8.0};
+    for (unsigned int i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+    {
+        int ticks = generateTrace(SimPins::digital[FEHIO::P3_1], speeds[i], glitchChance);
+        ReplayResult r = replay(bodyMicros, stallMicros, (unsigned long long)(REPLAY_SECONDS * 1000000.0));
+        r.trueTicks = ticks;
+        char label[16];
+        sprintf(label, "%.1f", speeds[i]);
+        printRow(label, r);
+    }
+    return 0;
+}
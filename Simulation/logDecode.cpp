@@ -0,0 +1,85 @@
+/*
+    Turns a run log from the SD card (runNNN.log, written by RunLog) back into CSV.
+
+    Usage: logDecode run000.log [out.csv]
+    Writes to stdout if no output file is given. Lines that aren't whole records (a run that lost power halfway
+    through a write) are skipped and counted on stderr.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "logRecords.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s runNNN.log [out.csv]\n", argv[0]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "r");
+    if (in == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    FILE *out = stdout;
+    if (argc > 2)
+    {
+        out = fopen(argv[2], "w");
+        if (out == NULL)
+        {
+            perror(argv[2]);
+            fclose(in);
+            return 1;
+        }
+    }
+
+    fprintf(out, "micros,seconds,type,arg");
+    for (int i = 0; i < LOG_VALUES; i++)
+    {
+        fprintf(out, ",v%d", i);
+    }
+    fprintf(out, "\n");
+
+    char line[256];
+    LogRecord record;
+    bool first = true;
+    unsigned long startMicros = 0;
+    int records = 0, bad = 0;
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+        {
+            continue;
+        }
+        if (!unpackRecord(line, record))
+        {
+            bad++;
+            continue;
+        }
+        if (first)
+        {
+            startMicros = record.micros;
+            first = false;
+        }
+        // Time since the first record. The unsigned subtraction handles the 32 bit microsecond counter wrapping.
+        unsigned long since = (record.micros - startMicros) & 0xffffffffUL;
+        fprintf(out, "%lu,%.6f,%s,%d", record.micros, since / 1000000.0, logTypeName(record.type), record.arg);
+        for (int i = 0; i < LOG_VALUES; i++)
+        {
+            fprintf(out, ",%g", record.v[i]);
+        }
+        fprintf(out, "\n");
+        records++;
+    }
+    fclose(in);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    fprintf(stderr, "%d records, %d bad lines skipped\n", records, bad);
+    return 0;
+}
@@ -0,0 +1,445 @@
+/*
+    Host implementations of the FEHLCD, FEHMotor, FEHServo, FEHBattery, FEHRPS, FEHSD, FEHBuzzer and FEHRandom
+    stand-ins. Everything that moves or senses goes through the simulated world (simWorld.h).
+*/
+#include <FEHUtility.h>
+#include <FEHLCD.h>
+#include <FEHMotor.h>
+#include <FEHServo.h>
+#include <FEHBattery.h>
+#include <FEHRPS.h>
+#include <FEHSD.h>
+#include <FEHBuzzer.h>
+#include <FEHRandom.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simWorld.h"
+
+FEHLCD LCD;
+FEHBattery Battery;
+FEHRPS RPS;
+FEHSD SD;
+FEHBuzzer Buzzer;
+FEHRandom Random;
+
+namespace SimLcd
+{
+    char lastLine[128];
+    unsigned long calls = 0;
+    unsigned long long drawMicros = 0;
+    unsigned long clearCost = 2000, textCost = 1000, fillCost = 3000;
+    void (*onText)(const char *line) = NULL;
+    float touchX = 160.0, touchY = 120.0;
+    bool touched = false;
+
+    void reset()
+    {
+        lastLine[0] = '\0';
+        calls = 0;
+        drawMicros = 0;
+        clearCost = 2000;
+        textCost = 1000;
+        fillCost = 3000;
+        touchX = 160.0;
+        touchY = 120.0;
+        touched = false;
+    }
+
+    void draw(unsigned long cost)
+    {
+        calls++;
+        drawMicros += cost;
+        SimClock::advance(cost);
+    }
+
+    void text(const char *line)
+    {
+        snprintf(lastLine, sizeof(lastLine), "%s", line);
+        draw(textCost);
+        if (onText != NULL)
+        {
+            onText(lastLine);
+        }
+    }
+}
+
+void FEHLCD::Clear()
+{
+    SimLcd::draw(SimLcd::clearCost);
+}
+
+void FEHLCD::Clear(unsigned int color)
+{
+    Clear();
+}
+
+void FEHLCD::SetBackgroundColor(unsigned int color)
+{
+}
+
+void FEHLCD::SetFontColor(unsigned int color)
+{
+}
+
+void FEHLCD::WriteLine(const char *str)
+{
+    SimLcd::text(str);
+}
+
+void FEHLCD::WriteLine(int i)
+{
+    char line[16];
+    snprintf(line, sizeof(line), "%d", i);
+    SimLcd::text(line);
+}
+
+void FEHLCD::WriteLine(float f)
+{
+    WriteLine((double)f);
+}
+
+void FEHLCD::WriteLine(double d)
+{
+    char line[32];
+    snprintf(line, sizeof(line), "%.3f", d);
+    SimLcd::text(line);
+}
+
+void FEHLCD::WriteLine(bool b)
+{
+    SimLcd::text(b ? "true" : "false");
+}
+
+void FEHLCD::WriteLine(char c)
+{
+    char line[2] = {c, '\0'};
+    SimLcd::text(line);
+}
+
+void FEHLCD::Write(const char *str)
+{
+    WriteLine(str);
+}
+
+void FEHLCD::Write(int i)
+{
+    WriteLine(i);
+}
+
+void FEHLCD::Write(float f)
+{
+    WriteLine(f);
+}
+
+void FEHLCD::Write(double d)
+{
+    WriteLine(d);
+}
+
+void FEHLCD::Write(bool b)
+{
+    WriteLine(b);
+}
+
+void FEHLCD::Write(char c)
+{
+    WriteLine(c);
+}
+
+void FEHLCD::WriteAt(const char *str, int x, int y)
+{
+    WriteLine(str);
+}
+
+void FEHLCD::WriteAt(int i, int x, int y)
+{
+    WriteLine(i);
+}
+
+void FEHLCD::WriteAt(float f, int x, int y)
+{
+    WriteLine(f);
+}
+
+void FEHLCD::WriteAt(double d, int x, int y)
+{
+    WriteLine(d);
+}
+
+void FEHLCD::WriteRC(const char *str, int row, int col)
+{
+    WriteLine(str);
+}
+
+void FEHLCD::WriteRC(int i, int row, int col)
+{
+    WriteLine(i);
+}
+
+void FEHLCD::WriteRC(float f, int row, int col)
+{
+    WriteLine(f);
+}
+
+void FEHLCD::FillRectangle(int x, int y, int width, int height)
+{
+    SimLcd::draw(SimLcd::fillCost);
+}
+
+void FEHLCD::DrawRectangle(int x, int y, int width, int height)
+{
+    SimLcd::draw(SimLcd::fillCost);
+}
+
+void FEHLCD::FillCircle(int x, int y, int r)
+{
+    SimLcd::draw(SimLcd::fillCost);
+}
+
+void FEHLCD::DrawCircle(int x, int y, int r)
+{
+    SimLcd::draw(SimLcd::fillCost);
+}
+
+void FEHLCD::DrawPixel(int x, int y)
+{
+}
+
+void FEHLCD::DrawHorizontalLine(int y, int x1, int x2)
+{
+}
+
+void FEHLCD::DrawVerticalLine(int x, int y1, int y2)
+{
+}
+
+bool FEHLCD::Touch(float *x, float *y)
+{
+    // The simulated operator taps as soon as they're asked to: pressed on one call, released on the next.
+    SimClock::advance(SimClock::timeReadCost);
+    SimLcd::touched = !SimLcd::touched;
+    *x = SimLcd::touchX;
+    *y = SimLcd::touchY;
+    return SimLcd::touched;
+}
+
+bool FEHLCD::Touch(int *x, int *y)
+{
+    float fx, fy;
+    bool pressed = Touch(&fx, &fy);
+    *x = (int)fx;
+    *y = (int)fy;
+    return pressed;
+}
+
+void FEHLCD::ClearBuffer()
+{
+    SimLcd::touched = false;
+}
+
+FEHMotor::FEHMotor(FEHMotorPort port, float maxVoltage) : port(port), maxVoltage(maxVoltage)
+{
+}
+
+void FEHMotor::SetPercent(float percent)
+{
+    SimWorld::motorPercent[port] = percent;
+}
+
+void FEHMotor::Stop()
+{
+    SimWorld::motorPercent[port] = 0.0;
+}
+
+FEHServo::FEHServo(FEHServoPort port) : port(port)
+{
+}
+
+void FEHServo::SetMin(int min)
+{
+}
+
+void FEHServo::SetMax(int max)
+{
+}
+
+void FEHServo::SetDegree(float degree)
+{
+    SimWorld::servoDegree[port] = degree;
+}
+
+void FEHServo::Off()
+{
+}
+
+void FEHServo::TouchCalibrate()
+{
+}
+
+float FEHBattery::Voltage()
+{
+    SimWorld::step();
+    return SimWorld::batteryReading();
+}
+
+void FEHRPS::InitializeTouchMenu()
+{
+    SimWorld::rpsOn = true;
+}
+
+float FEHRPS::X()
+{
+    SimWorld::step();
+    return SimWorld::rpsX();
+}
+
+float FEHRPS::Y()
+{
+    SimWorld::step();
+    return SimWorld::rpsY();
+}
+
+float FEHRPS::Heading()
+{
+    SimWorld::step();
+    return SimWorld::rpsHeading();
+}
+
+int FEHRPS::CurrentCourse()
+{
+    return SimWorld::config.course;
+}
+
+char FEHRPS::CurrentRegionLetter()
+{
+    return 'A' + SimWorld::config.course - 1;
+}
+
+int FEHRPS::CurrentRegion()
+{
+    return SimWorld::config.course - 1;
+}
+
+int FEHRPS::GetIceCream()
+{
+    return SimWorld::config.flavor;
+}
+
+/*
+    SD card. Each FEHFile is a host FILE, or a dummy when SimSd::directory is empty.
+*/
+struct FEHFile
+{
+    FILE *file;
+};
+
+namespace SimSd
+{
+    char directory[256] = "simsd";
+    unsigned long writeCost = 200, openCost = 5000;
+}
+
+FEHFile *FEHSD::FOpen(const char *name, const char *mode)
+{
+    SimClock::advance(SimSd::openCost);
+    FEHFile *handle = new FEHFile;
+    handle->file = NULL;
+    if (SimSd::directory[0] != '\0')
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", SimSd::directory, name);
+        handle->file = fopen(path, mode);
+    }
+    // Like the real card, a file that isn't there can't be opened for reading.
+    if (handle->file == NULL && mode[0] == 'r')
+    {
+        delete handle;
+        return NULL;
+    }
+    return handle;
+}
+
+int FEHSD::FClose(FEHFile *file)
+{
+    if (file == NULL)
+    {
+        return -1;
+    }
+    SimClock::advance(SimSd::openCost);
+    if (file->file != NULL)
+    {
+        fclose(file->file);
+    }
+    delete file;
+    return 0;
+}
+
+int FEHSD::FCloseAll()
+{
+    return 0;
+}
+
+int FEHSD::FPrintf(FEHFile *file, const char *format, ...)
+{
+    if (file == NULL)
+    {
+        return -1;
+    }
+    SimClock::advance(SimSd::writeCost);
+    if (file->file == NULL)
+    {
+        return 0;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vfprintf(file->file, format, args);
+    va_end(args);
+    return written;
+}
+
+int FEHSD::FScanf(FEHFile *file, const char *format, ...)
+{
+    if (file == NULL || file->file == NULL)
+    {
+        return -1;
+    }
+    SimClock::advance(SimSd::writeCost);
+    va_list args;
+    va_start(args, format);
+    int read = vfscanf(file->file, format, args);
+    va_end(args);
+    return read;
+}
+
+int FEHSD::FEof(FEHFile *file)
+{
+    return file == NULL || file->file == NULL || feof(file->file);
+}
+
+void FEHBuzzer::Beep()
+{
+}
+
+void FEHBuzzer::Buzz(int duration)
+{
+}
+
+void FEHBuzzer::Tone(int frequency, int duration)
+{
+}
+
+void FEHBuzzer::Off()
+{
+}
+
+void FEHRandom::Seed()
+{
+}
+
+int FEHRandom::RandInt()
+{
+    return rand() & 0x7fff;
+}
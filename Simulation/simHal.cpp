@@ -0,0 +1,187 @@
+/*
+    Host implementations of the FEHUtility and FEHIO stand-ins.
+*/
+#include <FEHUtility.h>
+#include <FEHIO.h>
+#include <stdio.h>
+#include <algorithm>
+
+namespace SimClock
+{
+    unsigned long long nowMicros = 0;
+    unsigned long timeReadCost = 2;
+    void (*onAdvance)() = NULL;
+
+    void advance(unsigned long long micros)
+    {
+        nowMicros += micros;
+        if (onAdvance != NULL)
+        {
+            onAdvance();
+        }
+    }
+
+    void reset()
+    {
+        nowMicros = 0;
+        timeReadCost = 2;
+    }
+}
+
+double TimeNow()
+{
+    SimClock::advance(SimClock::timeReadCost);
+    return SimClock::nowMicros / 1000000.0;
+}
+
+unsigned int TimeNowSec()
+{
+    return (unsigned int)TimeNow();
+}
+
+unsigned int TimeNowMSec()
+{
+    return (unsigned int)(TimeNow() * 1000.0);
+}
+
+void Sleep(int msec)
+{
+    SimClock::advance((unsigned long long)msec * 1000ULL);
+}
+
+void Sleep(float sec)
+{
+    Sleep((double)sec);
+}
+
+void Sleep(double sec)
+{
+    if (sec > 0.0)
+    {
+        SimClock::advance((unsigned long long)(sec * 1000000.0));
+    }
+}
+
+EdgeTrace::EdgeTrace()
+{
+    clear(false);
+}
+
+void EdgeTrace::clear(bool level)
+{
+    initialLevel = level;
+    edges.clear();
+}
+
+void EdgeTrace::addEdge(unsigned long long micros)
+{
+    if (edges.empty() || micros >= edges.back())
+    {
+        edges.push_back(micros);
+    }
+    else
+    {
+        edges.insert(std::upper_bound(edges.begin(), edges.end(), micros), micros);
+    }
+}
+
+bool EdgeTrace::levelAt(unsigned long long micros)
+{
+    size_t toggles = std::upper_bound(edges.begin(), edges.end(), micros) - edges.begin();
+    return initialLevel ^ (toggles % 2 == 1);
+}
+
+int EdgeTrace::edgesBetween(unsigned long long fromMicros, unsigned long long toMicros, FEHIO::FEHIOInterruptTrigger trigger)
+{
+    if (toMicros <= fromMicros)
+    {
+        return 0;
+    }
+    size_t first = std::upper_bound(edges.begin(), edges.end(), fromMicros) - edges.begin();
+    size_t last = std::upper_bound(edges.begin(), edges.end(), toMicros) - edges.begin();
+    if (trigger == FEHIO::EitherEdge)
+    {
+        return (int)(last - first);
+    }
+    // Edge number i (0 based) takes the pin from initialLevel^(i odd) to its opposite.
+    int count = 0;
+    for (size_t i = first; i < last; i++)
+    {
+        bool rising = (initialLevel ^ (i % 2 == 1)) == false;
+        if (rising == (trigger == FEHIO::RisingEdge))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool EdgeTrace::load(const char *fileName)
+{
+    FILE *trace = fopen(fileName, "r");
+    if (trace == NULL)
+    {
+        return false;
+    }
+    unsigned long long micros;
+    while (fscanf(trace, "%llu", &micros) == 1)
+    {
+        addEdge(micros);
+    }
+    fclose(trace);
+    return true;
+}
+
+namespace SimPins
+{
+    EdgeTrace digital[FEHIO::NUM_PINS];
+    float analog[FEHIO::NUM_PINS];
+    unsigned long digitalReadCost = 1;
+    unsigned long analogReadCost = 10;
+
+    void reset()
+    {
+        for (int i = 0; i < FEHIO::NUM_PINS; i++)
+        {
+            digital[i].clear(false);
+            analog[i] = 0.0;
+        }
+        digitalReadCost = 1;
+        analogReadCost = 10;
+    }
+}
+
+DigitalInputPin::DigitalInputPin(FEHIO::FEHIOPin pin) : pin(pin)
+{
+}
+
+bool DigitalInputPin::Value()
+{
+    SimClock::advance(SimPins::digitalReadCost);
+    return SimPins::digital[pin].levelAt(SimClock::nowMicros);
+}
+
+DigitalEncoder::DigitalEncoder(FEHIO::FEHIOPin pin, FEHIO::FEHIOInterruptTrigger trigger) : pin(pin), trigger(trigger), resetMicros(0)
+{
+}
+
+int DigitalEncoder::Counts()
+{
+    SimClock::advance(SimPins::digitalReadCost);
+    return SimPins::digital[pin].edgesBetween(resetMicros, SimClock::nowMicros, trigger);
+}
+
+void DigitalEncoder::ResetCounts()
+{
+    resetMicros = SimClock::nowMicros;
+}
+
+AnalogInputPin::AnalogInputPin(FEHIO::FEHIOPin pin) : pin(pin)
+{
+}
+
+float AnalogInputPin::Value()
+{
+    SimClock::advance(SimPins::analogReadCost);
+    return SimPins::analog[pin];
+}
@@ -0,0 +1,100 @@
+/*
+    simMission - runs the whole of Proteus_Project/main.cpp on the host against the simulated course.
+
+    main.cpp is compiled unchanged except that its main() is renamed robot_main() (see the Makefile). The FEH
+    stand-ins in this folder talk to the simulated world (simWorld.h), and time only moves when the robot code
+    reads the clock, sleeps, or does something that takes time on the Proteus, so a full run takes a fraction of
+    a second of wall time. The operator is simulated too, see simRun.h.
+
+    Usage:
+        ./simMission [-v] [-calibrate] [-seed n] [-random n] [-blue] [-flavor n] [-blockRamp] [-sd dir]
+    -v prints everything written to the LCD with the simulated time. -calibrate says yes to the motor
+    calibration (the result is saved on the simulated card and used by every run after). -blue makes the jukebox light blue.
+    -random n runs with the same randomized robot and course as run n of simMonteCarlo (before -blue/-flavor).
+    -blockRamp leaves something on the ramp so the robot can't get up it: the ramp step fails, and the burger, the
+    lever, the way back down and the ticket should all be skipped, straight on to the stop button.
+    The SD card is the simsd folder (made if needed), -sd "" throws everything written to it away.
+*/
+#include <FEHLCD.h>
+#include <FEHSD.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "simRun.h"
+
+#define STOP_BUTTON_X 28.7
+#define STOP_BUTTON_Y 8.5
+
+int main(int argc, char **argv)
+{
+    SimWorld::Config config = SimWorld::defaults();
+    bool verbose = false, calibrate = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "-calibrate") == 0)
+        {
+            calibrate = true;
+        }
+        else if (strcmp(argv[i], "-blue") == 0)
+        {
+            config.jukeboxRed = false;
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            config.seed = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-random") == 0 && i + 1 < argc)
+        {
+            config = SimRun::randomConfig(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-flavor") == 0 && i + 1 < argc)
+        {
+            config.flavor = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-blockRamp") == 0)
+        {
+            config.rampBlocked = true;
+        }
+        else if (strcmp(argv[i], "-sd") == 0 && i + 1 < argc)
+        {
+            snprintf(SimSd::directory, sizeof(SimSd::directory), "%s", argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-v] [-calibrate] [-seed n] [-random n] [-blue] [-flavor n] [-blockRamp] [-sd dir]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (SimSd::directory[0] != '\0')
+    {
+        mkdir(SimSd::directory, 0755);
+    }
+
+    clock_t wallStart = clock();
+    SimRun::Result result = SimRun::run(config, verbose, calibrate);
+    double wall = (double)(clock() - wallStart) / CLOCKS_PER_SEC;
+
+    printf("run time       %.2f s (simulated, from the start light)\n", result.runTime);
+    printf("start latency  %.1f ms (light on to first drive command)\n", result.startLatency);
+    printf("final pose     %.2f, %.2f heading %.1f\n", result.x, result.y, result.heading);
+    printf("stop button    %.2f in away\n", hypot(result.x - STOP_BUTTON_X, result.y - STOP_BUTTON_Y));
+    printf("wheel travel   %.1f in left, %.1f in right, %.1f s against a wall\n", SimWorld::leftTravel,
+           SimWorld::rightTravel, SimWorld::blockedMillis / 1000.0);
+    printf("lcd            %lu calls, %.2f s drawing\n", SimLcd::calls, SimLcd::drawMicros / 1000000.0);
+    printf("tasks         ");
+    for (int i = 0; i < NUM_SIM_TASKS; i++)
+    {
+        printf(" %s %s%s", SimWorld::taskName(i), result.taskDone[i] ? "yes" : "NO", i + 1 < NUM_SIM_TASKS ? "," : "\n");
+    }
+    printf("wall time      %.3f s\n", wall);
+    return 0;
+}
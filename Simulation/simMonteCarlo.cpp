@@ -0,0 +1,211 @@
+/*
+    simMonteCarlo - runs the full mission (main.cpp on the simulated course, see simRun.h) many times with a
+    randomized robot and course, and reports the run time distribution and how often each course task got done.
+
+    Every run is its own forked process, since main.cpp keeps its state in globals and a stuck run can only be
+    stopped by exiting. As many runs go at once as there are cores. Run n uses SimRun::randomConfig(seed + n), so
+    any single run can be replayed with ./simMission -random <seed + n> -v.
+
+    Usage:
+        ./simMonteCarlo [runs] [-j jobs] [-seed n] [-failures]
+    -failures lists every run that missed a task or got stuck.
+*/
+#include <FEHSD.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "simRun.h"
+
+#define DEFAULT_RUNS 1000
+
+/**
+ * @brief A run in progress: its child process and the pipe its result comes back on.
+ */
+struct Job
+{
+    pid_t pid;
+    int pipe;
+    unsigned int seed;
+};
+
+/**
+ * @brief Forks a child that does one run and writes its Result down a pipe.
+ */
+static bool startRun(unsigned int seed, Job &job)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        // Nothing on the card, and nothing the robot prints.
+        SimSd::directory[0] = '\0';
+        freopen("/dev/null", "w", stderr);
+        SimRun::Result result = SimRun::run(SimRun::randomConfig(seed), false);
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+    }
+    close(fds[1]);
+    job.pid = pid;
+    job.pipe = fds[0];
+    job.seed = seed;
+    return true;
+}
+
+/**
+ * @brief Value below which a fraction of the sorted times fall.
+ */
+static float percentile(const std::vector<float> &sorted, float fraction)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char **argv)
+{
+    int runs = DEFAULT_RUNS;
+    int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int seed = 1;
+    bool listFailures = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            jobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            seed = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-failures") == 0)
+        {
+            listFailures = true;
+        }
+        else if (argv[i][0] != '-' && atoi(argv[i]) > 0)
+        {
+            runs = atoi(argv[i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [runs] [-j jobs] [-seed n] [-failures]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (jobs < 1)
+    {
+        jobs = 1;
+    }
+
+    time_t wallStart = time(NULL);
+    std::vector<Job> running;
+    std::vector<float> times, latencies;
+    int taskCounts[NUM_SIM_TASKS] = {0};
+    int started = 0, stuck = 0, crashed = 0, allTasks = 0;
+    while (started < runs || !running.empty())
+    {
+        while (started < runs && (int)running.size() < jobs)
+        {
+            Job job;
+            if (!startRun(seed + started, job))
+            {
+                return 1;
+            }
+            running.push_back(job);
+            started++;
+        }
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+        {
+            perror("wait");
+            return 1;
+        }
+        for (size_t i = 0; i < running.size(); i++)
+        {
+            if (running[i].pid != pid)
+            {
+                continue;
+            }
+            Job job = running[i];
+            running.erase(running.begin() + i);
+            SimRun::Result result;
+            bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && read(job.pipe, &result, sizeof(result)) == (ssize_t)sizeof(result);
+            close(job.pipe);
+            if (!ok)
+            {
+                bool timedOut = WIFEXITED(status) && WEXITSTATUS(status) == SIM_STUCK_EXIT;
+                (timedOut ? stuck : crashed)++;
+                if (listFailures)
+                {
+                    printf("run %u: %s\n", job.seed, timedOut ? "stuck" : "crashed");
+                }
+                break;
+            }
+            times.push_back(result.runTime);
+            latencies.push_back(result.startLatency);
+            bool all = true;
+            for (int task = 0; task < NUM_SIM_TASKS; task++)
+            {
+                taskCounts[task] += result.taskDone[task];
+                all = all && result.taskDone[task];
+            }
+            allTasks += all;
+            if (listFailures && !all)
+            {
+                printf("run %u: missed", job.seed);
+                for (int task = 0; task < NUM_SIM_TASKS; task++)
+                {
+                    if (!result.taskDone[task])
+                    {
+                        printf(" [%s]", SimWorld::taskName(task));
+                    }
+                }
+                printf("\n");
+            }
+            break;
+        }
+    }
+
+    std::sort(times.begin(), times.end());
+    std::sort(latencies.begin(), latencies.end());
+    printf("%d runs (%d finished, %d stuck, %d crashed) on %d jobs, %ld s wall time\n", runs, (int)times.size(), stuck,
+           crashed, jobs, (long)(time(NULL) - wallStart));
+    if (!times.empty())
+    {
+        printf("run time (s)   min %.1f  p10 %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", times.front(),
+               percentile(times, 0.10), percentile(times, 0.50), percentile(times, 0.90), percentile(times, 0.99),
+               times.back());
+        printf("start (ms)     min %.1f  p10 %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", latencies.front(),
+               percentile(latencies, 0.10), percentile(latencies, 0.50), percentile(latencies, 0.90),
+               percentile(latencies, 0.99), latencies.back());
+    }
+    printf("task success (of all %d runs)\n", runs);
+    for (int task = 0; task < NUM_SIM_TASKS; task++)
+    {
+        printf("  %-16s %5.1f%%\n", SimWorld::taskName(task), 100.0 * taskCounts[task] / runs);
+    }
+    printf("  %-16s %5.1f%%\n", "everything", 100.0 * allTasks / runs);
+    return 0;
+}
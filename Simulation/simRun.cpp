@@ -0,0 +1,134 @@
+/*
+    One simulated run of main.cpp, see simRun.h.
+*/
+#include <FEHUtility.h>
+#include <FEHLCD.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+
+#include "simRun.h"
+
+// Spread of the randomized configs: motor speed (fraction, standard deviation), battery voltage range, RPS noise
+// ranges (in, degrees), encoder glitch chance up to, start position (in, degrees, either way).
+#define MOTOR_SPREAD 0.05
+#define BATTERY_MIN 10.8
+#define BATTERY_MAX 12.3
+#define RPS_NOISE_MIN 0.05
+#define RPS_NOISE_MAX 0.3
+#define RPS_HEADING_NOISE_MIN 0.2
+#define RPS_HEADING_NOISE_MAX 1.5
+#define GLITCH_MAX 0.02
+#define START_SPREAD 0.5
+#define START_HEADING_SPREAD 5.0
+
+namespace SimRun
+{
+    namespace
+    {
+        /**
+         * @brief Where the operator puts the robot when the LCD asks for a waypoint.
+         */
+        struct Placement
+        {
+            const char *prompt;
+            float x, y, heading;
+        };
+
+        const Placement placements[] = {
+            {"JUKEBOX LED", 8.2, 22.0, 180.0},
+            {"RED BUTTON", 7.0, 15.8, 270.0},
+            {"BLUE BUTTON", 9.3, 15.8, 270.0},
+            {"BOTTOM RIGHT WALL", 31.0, 20.0, 0.0},
+            {"TICKET SLIDER", 30.8, 42.7, 90.0},
+        };
+
+        bool echo = false, calibrateMotors = false;
+
+        void operatorScript(const char *line)
+        {
+            if (echo)
+            {
+                printf("%9.3f  %s\n", SimClock::nowMicros / 1000000.0, line);
+            }
+            for (size_t i = 0; i < sizeof(placements) / sizeof(placements[0]); i++)
+            {
+                if (strstr(line, placements[i].prompt) != NULL)
+                {
+                    SimWorld::place(placements[i].x, placements[i].y, placements[i].heading);
+                }
+            }
+            if (strstr(line, "Calibrate motors") != NULL)
+            {
+                // Left half of the screen is yes.
+                SimLcd::touchX = calibrateMotors ? 80.0 : 240.0;
+            }
+            else if (strstr(line, "Tap to continue") != NULL)
+            {
+                SimWorld::place(SimWorld::config.startX, SimWorld::config.startY, SimWorld::config.startHeading);
+            }
+            else if (strstr(line, "Press to begin") != NULL)
+            {
+                SimWorld::startLightIn(0.5);
+            }
+        }
+
+        void advanceWorld()
+        {
+            SimWorld::step();
+            if (SimClock::nowMicros > (unsigned long long)(SIM_TIME_LIMIT * 1000000.0))
+            {
+                fprintf(stderr, "still running after %.0f s of simulated time, giving up\n", SIM_TIME_LIMIT);
+                exit(SIM_STUCK_EXIT);
+            }
+        }
+    }
+
+    Result run(const SimWorld::Config &config, bool verbose, bool calibrate)
+    {
+        echo = verbose;
+        calibrateMotors = calibrate;
+        SimClock::reset();
+        SimClock::timeReadCost = SIM_TIME_READ_COST;
+        SimLcd::reset();
+        SimWorld::reset(config);
+        SimClock::onAdvance = advanceWorld;
+        SimLcd::onText = operatorScript;
+
+        robot_main();
+
+        Result result;
+        result.runTime = (SimClock::nowMicros - SimWorld::startLightMicros) / 1000000.0;
+        result.startLatency = (SimWorld::firstMoveMicros - SimWorld::startLightMicros) / 1000.0;
+        result.x = SimWorld::x;
+        result.y = SimWorld::y;
+        result.heading = SimWorld::heading;
+        for (int i = 0; i < NUM_SIM_TASKS; i++)
+        {
+            result.taskDone[i] = SimWorld::taskDone[i];
+        }
+        return result;
+    }
+
+    SimWorld::Config randomConfig(unsigned int seed)
+    {
+        std::mt19937 random(seed);
+        std::normal_distribution<float> gaussian(0.0, 1.0);
+        std::uniform_real_distribution<float> uniform(0.0, 1.0);
+        SimWorld::Config config = SimWorld::defaults();
+        config.seed = seed;
+        config.leftMaxSpeed *= 1.0 + MOTOR_SPREAD * gaussian(random);
+        config.rightMaxSpeed *= 1.0 + MOTOR_SPREAD * gaussian(random);
+        config.batteryVolts = BATTERY_MIN + (BATTERY_MAX - BATTERY_MIN) * uniform(random);
+        config.rpsNoise = RPS_NOISE_MIN + (RPS_NOISE_MAX - RPS_NOISE_MIN) * uniform(random);
+        config.rpsHeadingNoise = RPS_HEADING_NOISE_MIN + (RPS_HEADING_NOISE_MAX - RPS_HEADING_NOISE_MIN) * uniform(random);
+        config.glitchChance = GLITCH_MAX * uniform(random);
+        config.startX += START_SPREAD * (2.0 * uniform(random) - 1.0);
+        config.startY += START_SPREAD * (2.0 * uniform(random) - 1.0);
+        config.startHeading += START_HEADING_SPREAD * (2.0 * uniform(random) - 1.0);
+        config.jukeboxRed = uniform(random) < 0.5;
+        config.flavor = (int)(3.0 * uniform(random)) % 3;
+        return config;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef SIMRUN_H
+#define SIMRUN_H
+
+#include "simWorld.h"
+
+/*
+    Runs main.cpp (compiled as robot_main(), see the Makefile) once on the simulated course, with a simulated
+    operator answering the LCD prompts: for each waypoint prompt the robot is put down on that waypoint (default
+    coordinates from Waypoints), "Tap to continue." puts it on the start position, and "Press to begin" turns the
+    start light on half a second later. The motor calibration is skipped unless asked for.
+*/
+
+// Clock cost of a TimeNow() read in the simulation, in microseconds. Higher than the Proteus's real loop overhead
+// but still well under a control period, and it keeps the number of passes through the busy loops down.
+#define SIM_TIME_READ_COST 20
+// A run that hasn't finished after this much simulated time is stuck somewhere. The process exits with
+// SIM_STUCK_EXIT, there is no getting back out of the robot code.
+#define SIM_TIME_LIMIT 600.0
+#define SIM_STUCK_EXIT 2
+
+int robot_main(void);
+
+namespace SimRun
+{
+    /**
+     * @brief How a run went.
+     */
+    struct Result
+    {
+        // Simulated seconds from the start light to robot_main() returning, and milliseconds from the start light to
+        // the first drive motor command.
+        float runTime, startLatency;
+        // Where the robot ended up.
+        float x, y, heading;
+        bool taskDone[NUM_SIM_TASKS];
+    };
+
+    // Runs the mission once. verbose prints everything written to the LCD with the simulated time, calibrate has
+    // the operator say yes to the motor calibration.
+    Result run(const SimWorld::Config &config, bool verbose, bool calibrate = false);
+
+    /**
+     * @brief A robot and course that's a bit off from the defaults, the way it is from one practice run to the
+     * next: motor asymmetry, battery voltage, RPS noise, encoder glitches, where it's put down at the start, the
+     * jukebox colour and ice cream flavor. Same seed, same config.
+     */
+    SimWorld::Config randomConfig(unsigned int seed);
+}
+
+#endif
@@ -0,0 +1,510 @@
+/*
+    Simulated course, see simWorld.h.
+*/
+#include <FEHUtility.h>
+#include <FEHIO.h>
+#include <math.h>
+#include <random>
+
+#include "simWorld.h"
+
+// Wired the same as main.cpp.
+#define LEFT_ENCODER_PIN FEHIO::P3_1
+#define RIGHT_ENCODER_PIN FEHIO::P3_0
+#define CDS_PIN FEHIO::P1_0
+#define LEFT_OPTO_PIN FEHIO::P0_2
+#define MID_OPTO_PIN FEHIO::P0_1
+#define RIGHT_OPTO_PIN FEHIO::P0_0
+#define LEFT_MOTOR 0
+#define RIGHT_MOTOR 3
+
+// Physics step in microseconds.
+#define STEP_US 1000
+// Poses kept for RPS latency, one per step. Enough for half a second.
+#define POSE_HISTORY 512
+
+#define COURSE_WIDTH 36.0
+#define COURSE_LENGTH 72.0
+
+// Optosensors are this far ahead of center, the CdS cell this far.
+#define OPTO_FORWARD 2.5
+#define OPTO_SPACING 0.6
+#define CDS_FORWARD 1.5
+// Strip of tape leading up to the trash can, and its half width.
+#define TAPE_X1 14.0
+#define TAPE_Y1 18.8
+#define TAPE_X2 5.0
+#define TAPE_Y2 25.0
+#define TAPE_HALF_WIDTH 0.5
+// The trash can at the end of the tape. The robot's center can't get closer than TRASH_CAN_RADIUS to this, which
+// leaves it at the trash waypoint when it runs into the can head on.
+#define TRASH_CAN_X 3.1
+#define TRASH_CAN_Y 26.6
+#define TRASH_CAN_RADIUS 4.5
+// What's left on the ramp with rampBlocked, the box the robot's center can't get into, across the whole ramp.
+#define RAMP_BLOCK_X1 12.0
+#define RAMP_BLOCK_X2 23.0
+#define RAMP_BLOCK_Y1 28.0
+#define RAMP_BLOCK_Y2 32.0
+// Readings with each sensor's spot all on the tape and all off it, the levels measured on the robot (LEFT_OPTO_ON
+// and the rest in main.cpp). The middle sensor sees the tape much more weakly than the outer two. The spot is
+// OPTO_SPOT across, so the reading ramps between the two as it crosses an edge.
+#define LEFT_OPTO_ON_TAPE 2.3
+#define MID_OPTO_ON_TAPE 1.3
+#define RIGHT_OPTO_ON_TAPE 2.5
+#define LEFT_OPTO_OFF_TAPE 0.18
+#define MID_OPTO_OFF_TAPE 0.2
+#define RIGHT_OPTO_OFF_TAPE 0.23
+#define OPTO_SPOT 0.4
+// CdS voltages over a red light, a blue light and nothing, and how close it has to be to see a light.
+#define CDS_RED 0.6
+#define CDS_BLUE 1.6
+#define CDS_AMBIENT 2.9
+#define LIGHT_RANGE 3.0
+#define JUKEBOX_X 8.2
+#define JUKEBOX_Y 22.0
+// Start position, the start light is under it.
+#define START_X 29.0
+#define START_Y 14.0
+#define START_HEADING 135.0
+
+// Course task positions. A button counts as pressed when the robot gets within BUTTON_RANGE of it heading down the
+// course (within BUTTON_HEADING of 270). Servo jobs count when the servo is swung to its position within
+// SERVO_RANGE of the spot. The ice cream lever is pulled by the tray, LEVER_REACH in front of the robot.
+#define RED_BUTTON_X 7.0
+#define RED_BUTTON_Y 15.8
+#define BLUE_BUTTON_X 9.3
+#define BLUE_BUTTON_Y 15.8
+#define STOP_BUTTON_X 28.7
+#define STOP_BUTTON_Y 8.5
+#define BUTTON_RANGE 1.0
+#define BUTTON_HEADING 30.0
+#define TRASH_X 6.8
+#define TRASH_Y 24.0
+#define GRILL_X 30.8
+#define GRILL_Y 61.4
+#define TICKET_X 30.8
+#define TICKET_Y 42.7
+#define SERVO_RANGE 3.0
+#define LEVER_REACH 4.5
+#define LEVER_RANGE 2.2
+// Turn (degrees, left) with the ticket arm down that slides the ticket.
+#define TICKET_SLIDE_TURN 40.0
+// Servo ports and the angles that do the job.
+#define TRAY_SERVO 0
+#define TICKET_SERVO 1
+#define BURGER_SERVO 7
+#define TRAY_DUMP 90.0
+#define TRAY_LEVER 85.0
+#define BURGER_FLIP 105.0
+#define TICKET_DOWN 90.0
+
+namespace SimWorld
+{
+    Config config;
+    float x, y, heading;
+    float motorPercent[4];
+    float servoDegree[8];
+    bool startLight;
+    unsigned long long startLightMicros;
+    unsigned long long firstMoveMicros;
+    bool rpsOn;
+    float leftTravel, rightTravel;
+    unsigned long blockedMillis;
+    bool taskDone[NUM_SIM_TASKS];
+
+    namespace
+    {
+        unsigned long long worldMicros;
+        // Wheel surface speeds in in/s (forward positive), and travel since the last encoder edge.
+        float leftSpeed, rightSpeed;
+        float leftTick, rightTick;
+        float historyX[POSE_HISTORY], historyY[POSE_HISTORY], historyHeading[POSE_HISTORY];
+        int historyHead;
+        unsigned long long nextFrameMicros;
+        float frameX, frameY, frameHeading;
+        // What the CdS cell reads, lagging behind the light it sees.
+        float cdsLevel;
+        std::mt19937 random;
+        std::normal_distribution<float> gaussian(0.0, 1.0);
+        std::uniform_real_distribution<float> uniform(0.0, 1.0);
+        // Pressed the wrong jukebox button or pulled the wrong lever first, the task can't be done any more.
+        bool wrongButton, wrongLever;
+        // Heading when the ticket arm came down on the slider, or -1.
+        float ticketHeading;
+        // Ice cream lever positions by flavor.
+        const float leverX[3] = {6.2, 9.5, 12.8};
+        const float leverY[3] = {57.5, 60.5, 63.5};
+
+        float wrap360(float angle)
+        {
+            angle = fmod(angle, 360.0);
+            return angle < 0.0 ? angle + 360.0 : angle;
+        }
+
+        /**
+         * @brief Speed a wheel is heading for at a motor percent, forward positive.
+         */
+        float targetSpeed(float percent, float maxSpeed)
+        {
+            if (fabs(percent) < config.deadband)
+            {
+                return 0.0;
+            }
+            if (percent > 100.0)
+            {
+                percent = 100.0;
+            }
+            if (percent < -100.0)
+            {
+                percent = -100.0;
+            }
+            return percent / 100.0 * maxSpeed * batteryVolts() / config.nominalVolts;
+        }
+
+        /**
+         * @brief Adds an edge to an encoder pin for every inchesPerTick the wheel has turned.
+         */
+        void tick(float &travel, float moved, FEHIO::FEHIOPin pin)
+        {
+            travel += fabs(moved);
+            while (travel >= config.inchesPerTick)
+            {
+                travel -= config.inchesPerTick;
+                SimPins::digital[pin].addEdge(worldMicros);
+                if (config.glitchChance > 0.0 && uniform(random) < config.glitchChance)
+                {
+                    SimPins::digital[pin].addEdge(worldMicros + 20);
+                    SimPins::digital[pin].addEdge(worldMicros + 40);
+                }
+            }
+        }
+
+        /**
+         * @brief How much of an optosensor's spot is on the tape, 0 to 1.
+         */
+        float tapeCover(float px, float py)
+        {
+            float dx = TAPE_X2 - TAPE_X1, dy = TAPE_Y2 - TAPE_Y1;
+            float t = ((px - TAPE_X1) * dx + (py - TAPE_Y1) * dy) / (dx * dx + dy * dy);
+            if (t < 0.0 || t > 1.0)
+            {
+                return 0.0;
+            }
+            float off = hypot(TAPE_X1 + t * dx - px, TAPE_Y1 + t * dy - py);
+            float cover = (TAPE_HALF_WIDTH + OPTO_SPOT / 2.0 - off) / OPTO_SPOT;
+            return cover < 0.0 ? 0.0 : (cover > 1.0 ? 1.0 : cover);
+        }
+
+        bool near(float px, float py, float range)
+        {
+            return hypot(x - px, y - py) < range;
+        }
+
+        float headingOff(float target)
+        {
+            float off = fabs(wrap360(heading - target));
+            return off > 180.0 ? 360.0 - off : off;
+        }
+
+        /**
+         * @brief Marks off any course task the robot has just done.
+         */
+        void checkTasks()
+        {
+            bool headingDown = headingOff(270.0) < BUTTON_HEADING;
+            float buttonX = config.jukeboxRed ? RED_BUTTON_X : BLUE_BUTTON_X;
+            float otherX = config.jukeboxRed ? BLUE_BUTTON_X : RED_BUTTON_X;
+            if (headingDown && !taskDone[SIM_TASK_JUKEBOX] && near(otherX, RED_BUTTON_Y, BUTTON_RANGE))
+            {
+                wrongButton = true;
+            }
+            if (headingDown && !wrongButton && near(buttonX, RED_BUTTON_Y, BUTTON_RANGE))
+            {
+                taskDone[SIM_TASK_JUKEBOX] = true;
+            }
+            if (servoDegree[TRAY_SERVO] >= TRAY_DUMP && near(TRASH_X, TRASH_Y, SERVO_RANGE))
+            {
+                taskDone[SIM_TASK_TRAY] = true;
+            }
+            if (servoDegree[BURGER_SERVO] >= BURGER_FLIP && near(GRILL_X, GRILL_Y, SERVO_RANGE))
+            {
+                taskDone[SIM_TASK_BURGER] = true;
+            }
+            if (servoDegree[TRAY_SERVO] >= TRAY_LEVER && !taskDone[SIM_TASK_LEVER] && !wrongLever)
+            {
+                float rads = heading * M_PI / 180.0;
+                float reachX = x + LEVER_REACH * cos(rads), reachY = y + LEVER_REACH * sin(rads);
+                for (int flavor = 0; flavor < 3; flavor++)
+                {
+                    if (hypot(reachX - leverX[flavor], reachY - leverY[flavor]) < LEVER_RANGE)
+                    {
+                        taskDone[SIM_TASK_LEVER] = flavor == config.flavor;
+                        wrongLever = flavor != config.flavor;
+                    }
+                }
+            }
+            if (servoDegree[TICKET_SERVO] >= 0.0 && servoDegree[TICKET_SERVO] <= TICKET_DOWN && near(TICKET_X, TICKET_Y, SERVO_RANGE))
+            {
+                if (ticketHeading < 0.0)
+                {
+                    ticketHeading = heading;
+                }
+                else if (wrap360(heading - ticketHeading) >= TICKET_SLIDE_TURN && wrap360(heading - ticketHeading) < 180.0)
+                {
+                    taskDone[SIM_TASK_TICKET] = true;
+                }
+            }
+            else
+            {
+                ticketHeading = -1.0;
+            }
+            if (headingDown && near(STOP_BUTTON_X, STOP_BUTTON_Y, BUTTON_RANGE))
+            {
+                taskDone[SIM_TASK_STOP] = true;
+            }
+        }
+
+        void updateSensors()
+        {
+            cdsLevel += (cdsVolts() - cdsLevel) * (STEP_US / 1000000.0) / config.cdsLag;
+            SimPins::analog[CDS_PIN] = cdsLevel + config.cdsNoise * gaussian(random);
+            SimPins::analog[LEFT_OPTO_PIN] = optoVolts(OPTO_SPACING, LEFT_OPTO_OFF_TAPE, LEFT_OPTO_ON_TAPE);
+            SimPins::analog[MID_OPTO_PIN] = optoVolts(0.0, MID_OPTO_OFF_TAPE, MID_OPTO_ON_TAPE);
+            SimPins::analog[RIGHT_OPTO_PIN] = optoVolts(-OPTO_SPACING, RIGHT_OPTO_OFF_TAPE, RIGHT_OPTO_ON_TAPE);
+        }
+
+        /**
+         * @brief One physics step: wheel speeds, chassis motion, walls, encoders, RPS frames.
+         */
+        void stepOnce()
+        {
+            worldMicros += STEP_US;
+            float dt = STEP_US / 1000000.0;
+            // Right motor is mounted backwards, negative percent drives it forward.
+            float leftTarget = targetSpeed(motorPercent[LEFT_MOTOR], config.leftMaxSpeed);
+            float rightTarget = targetSpeed(-motorPercent[RIGHT_MOTOR], config.rightMaxSpeed);
+            leftSpeed += (leftTarget - leftSpeed) * dt / config.motorLag;
+            rightSpeed += (rightTarget - rightSpeed) * dt / config.motorLag;
+
+            float left = leftSpeed * dt, right = rightSpeed * dt;
+            float rads = heading * M_PI / 180.0 + (right - left) / (2.0 * config.trackWidth);
+            float newX = x + cos(rads) * (left + right) / 2.0;
+            float newY = y + sin(rads) * (left + right) / 2.0;
+            float margin = config.wallMargin;
+            if (newX < margin || newX > COURSE_WIDTH - margin || newY < margin || newY > COURSE_LENGTH - margin ||
+                hypot(newX - TRASH_CAN_X, newY - TRASH_CAN_Y) < TRASH_CAN_RADIUS ||
+                (config.rampBlocked && newX > RAMP_BLOCK_X1 && newX < RAMP_BLOCK_X2 && newY > RAMP_BLOCK_Y1 &&
+                 newY < RAMP_BLOCK_Y2))
+            {
+                // Up against a wall, the trash can or whatever's on the ramp. The motors stall, so the wheels (and the encoders) stop too.
+                leftSpeed = 0.0;
+                rightSpeed = 0.0;
+                blockedMillis++;
+            }
+            else
+            {
+                x = newX;
+                y = newY;
+                heading = wrap360(heading + (right - left) / config.trackWidth * 180.0 / M_PI);
+                leftTravel += fabs(left);
+                rightTravel += fabs(right);
+                tick(leftTick, left, LEFT_ENCODER_PIN);
+                tick(rightTick, right, RIGHT_ENCODER_PIN);
+            }
+
+            historyHead = (historyHead + 1) % POSE_HISTORY;
+            historyX[historyHead] = x;
+            historyY[historyHead] = y;
+            historyHeading[historyHead] = heading;
+            if (rpsOn && worldMicros >= nextFrameMicros)
+            {
+                nextFrameMicros += (unsigned long long)(config.rpsPeriod * 1000000.0);
+                int back = (int)(config.rpsLatency * 1000000.0 / STEP_US);
+                back = back >= POSE_HISTORY ? POSE_HISTORY - 1 : back;
+                int old = (historyHead - back + POSE_HISTORY) % POSE_HISTORY;
+                frameX = historyX[old] + config.rpsNoise * gaussian(random);
+                frameY = historyY[old] + config.rpsNoise * gaussian(random);
+                frameHeading = wrap360(historyHeading[old] - 90.0 + config.rpsHeadingNoise * gaussian(random));
+            }
+            if (!startLight && startLightMicros != 0 && worldMicros >= startLightMicros)
+            {
+                startLight = true;
+            }
+            if (startLight && firstMoveMicros == 0 && (motorPercent[LEFT_MOTOR] != 0.0 || motorPercent[RIGHT_MOTOR] != 0.0))
+            {
+                firstMoveMicros = worldMicros;
+            }
+            updateSensors();
+            // Nothing counts while the operator is still setting up.
+            if (startLight)
+            {
+                checkTasks();
+            }
+        }
+    }
+
+    Config defaults()
+    {
+        Config c;
+        // LEFTPERCENT/RIGHTPERCENT (58.4, -48.2) make 20 ticks/s, 10.2 in/s.
+        c.leftMaxSpeed = 17.5;
+        c.rightMaxSpeed = 21.2;
+        c.deadband = 5.0;
+        c.motorLag = 0.1;
+        c.batteryVolts = 11.5;
+        c.nominalVolts = 11.5;
+        c.batterySag = 0.6;
+        c.batteryNoise = 0.05;
+        c.trackWidth = 8.0;
+        c.inchesPerTick = M_PI * 3.25 / 20.0;
+        c.rpsPeriod = 0.125;
+        c.rpsLatency = 0.15;
+        c.rpsNoise = 0.1;
+        c.rpsHeadingNoise = 0.5;
+        c.glitchChance = 0.0;
+        c.cdsLag = 0.015;
+        c.cdsNoise = 0.02;
+        c.wallMargin = 3.0;
+        c.rampBlocked = false;
+        c.startX = START_X;
+        c.startY = START_Y;
+        c.startHeading = START_HEADING;
+        c.jukeboxRed = true;
+        c.flavor = 1;
+        c.course = 1;
+        c.seed = 1;
+        return c;
+    }
+
+    void reset(const Config &newConfig)
+    {
+        config = newConfig;
+        random.seed(config.seed);
+        gaussian.reset();
+        worldMicros = SimClock::nowMicros;
+        for (int i = 0; i < 4; i++)
+        {
+            motorPercent[i] = 0.0;
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            servoDegree[i] = -1.0;
+        }
+        startLight = false;
+        startLightMicros = 0;
+        firstMoveMicros = 0;
+        rpsOn = false;
+        nextFrameMicros = 0;
+        leftTravel = 0.0;
+        rightTravel = 0.0;
+        blockedMillis = 0;
+        for (int i = 0; i < NUM_SIM_TASKS; i++)
+        {
+            taskDone[i] = false;
+        }
+        wrongButton = false;
+        wrongLever = false;
+        ticketHeading = -1.0;
+        SimPins::digital[LEFT_ENCODER_PIN].clear(false);
+        SimPins::digital[RIGHT_ENCODER_PIN].clear(false);
+        place(config.startX, config.startY, config.startHeading);
+        frameX = x;
+        frameY = y;
+        frameHeading = wrap360(heading - 90.0);
+        cdsLevel = cdsVolts();
+        updateSensors();
+        SimClock::onAdvance = step;
+    }
+
+    void step()
+    {
+        while (worldMicros + STEP_US <= SimClock::nowMicros)
+        {
+            stepOnce();
+        }
+    }
+
+    void place(float newX, float newY, float newHeading)
+    {
+        x = newX;
+        y = newY;
+        heading = wrap360(newHeading);
+        leftSpeed = 0.0;
+        rightSpeed = 0.0;
+        leftTick = 0.0;
+        rightTick = 0.0;
+        for (int i = 0; i < POSE_HISTORY; i++)
+        {
+            historyX[i] = x;
+            historyY[i] = y;
+            historyHeading[i] = heading;
+        }
+        historyHead = 0;
+    }
+
+    void startLightIn(double seconds)
+    {
+        startLightMicros = SimClock::nowMicros + (unsigned long long)(seconds * 1000000.0);
+        if (startLightMicros == 0)
+        {
+            startLightMicros = 1;
+        }
+    }
+
+    float batteryVolts()
+    {
+        float load = (fabs(motorPercent[LEFT_MOTOR]) + fabs(motorPercent[RIGHT_MOTOR])) / 200.0;
+        return config.batteryVolts - config.batterySag * (load > 1.0 ? 1.0 : load);
+    }
+
+    float batteryReading()
+    {
+        return batteryVolts() + config.batteryNoise * gaussian(random);
+    }
+
+    const char *taskName(int task)
+    {
+        static const char *names[NUM_SIM_TASKS] = {"jukebox button", "tray", "burger flip", "ice cream lever",
+                                                   "ticket slide", "stop button"};
+        return task >= 0 && task < NUM_SIM_TASKS ? names[task] : "unknown";
+    }
+
+    float rpsX()
+    {
+        return rpsOn ? frameX : -1.0;
+    }
+
+    float rpsY()
+    {
+        return rpsOn ? frameY : -1.0;
+    }
+
+    float rpsHeading()
+    {
+        return rpsOn ? frameHeading : -1.0;
+    }
+
+    float cdsVolts()
+    {
+        float rads = heading * M_PI / 180.0;
+        float cx = x + CDS_FORWARD * cos(rads), cy = y + CDS_FORWARD * sin(rads);
+        if (startLight && hypot(cx - START_X, cy - START_Y) < LIGHT_RANGE)
+        {
+            return CDS_RED;
+        }
+        if (hypot(cx - JUKEBOX_X, cy - JUKEBOX_Y) < LIGHT_RANGE)
+        {
+            return config.jukeboxRed ? CDS_RED : CDS_BLUE;
+        }
+        return CDS_AMBIENT;
+    }
+
+    float optoVolts(float lateral, float offTape, float onTape)
+    {
+        float rads = heading * M_PI / 180.0;
+        float ox = x + OPTO_FORWARD * cos(rads) - lateral * sin(rads);
+        float oy = y + OPTO_FORWARD * sin(rads) + lateral * cos(rads);
+        return offTape + (onTape - offTape) * tapeCover(ox, oy);
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef SIMWORLD_H
+#define SIMWORLD_H
+
+/*
+    Simulated course for running the robot code on the host.
+
+    A differential drive chassis on a flat 36 x 72 in course, stepped every millisecond of simulated time (the
+    clock in FEHUtility.h calls step() whenever it moves). The FEH stand-ins read and write it:
+        - FEHMotor commands set the wheel speed targets. Wheel speed lags the command (first order), has a
+          deadband, and scales with battery voltage, which sags with the load. Left is Motor0, right is Motor3 and is mounted backwards.
+        - Every inchesPerTick of wheel travel puts an edge on that wheel's encoder pin (SimPins::digital).
+        - The optosensors see a strip of tape, the CdS cell sees the start light and the jukebox light. The cell
+          takes cdsLag to follow a change in light, like a real one.
+        - RPS publishes a frame every rpsPeriod seconds, showing where the robot was rpsLatency seconds ago plus
+          gaussian noise. Heading is in RPS terms (robot heading - 90).
+    Poses are the same as odometry.h: x, y in inches, heading in degrees counterclockwise from +x.
+
+    Course tasks are judged from where the robot is and what its servos are doing, against rough positions of the
+    buttons and levers (the coordinates the robot's own waypoints use). Good enough to tell a run that got there
+    from one that didn't, not a model of the mechanisms.
+*/
+
+// Course tasks, for taskDone[].
+#define SIM_TASK_JUKEBOX 0
+#define SIM_TASK_TRAY 1
+#define SIM_TASK_BURGER 2
+#define SIM_TASK_LEVER 3
+#define SIM_TASK_TICKET 4
+#define SIM_TASK_STOP 5
+#define NUM_SIM_TASKS 6
+
+namespace SimWorld
+{
+    /**
+     * @brief Everything about the robot and course that a run can change. Defaults match the real robot.
+     */
+    struct Config
+    {
+        // Wheel surface speed in in/s at 100% and the nominal battery voltage, per side.
+        float leftMaxSpeed, rightMaxSpeed;
+        // Percent below which a motor doesn't turn, and wheel speed time constant in seconds.
+        float deadband, motorLag;
+        // Battery voltage with the motors off, the voltage the max speeds were measured at, how far it drops with
+        // both drive motors at 100%, and noise on a reading (standard deviation).
+        float batteryVolts, nominalVolts, batterySag, batteryNoise;
+        // Distance between the wheels, and wheel travel per encoder edge, in inches.
+        float trackWidth, inchesPerTick;
+        // RPS frame period and latency in seconds, noise standard deviations in inches and degrees.
+        float rpsPeriod, rpsLatency, rpsNoise, rpsHeadingNoise;
+        // Chance that an encoder edge is followed by a bounce (two extra edges a few microseconds later).
+        float glitchChance;
+        // CdS cell response time constant in seconds, and noise on a reading (standard deviation, volts).
+        float cdsLag, cdsNoise;
+        // Closest the robot's center gets to a wall.
+        float wallMargin;
+        // Something left on the ramp, so the robot can't get up it. For checking what the run does when a task
+        // fails and the ones behind it can't be done.
+        bool rampBlocked;
+        // Where the operator puts the robot for the start.
+        float startX, startY, startHeading;
+        // Jukebox light colour (true for red), ice cream flavor RPS hands out, course number.
+        bool jukeboxRed;
+        int flavor, course;
+        // Seed for the noise.
+        unsigned int seed;
+    };
+
+    extern Config config;
+
+    // Robot pose.
+    extern float x, y, heading;
+    // Motor percents as commanded, indexed by FEHMotor port.
+    extern float motorPercent[4];
+    // Servo angles as commanded, -1 until set, indexed by FEHServo port.
+    extern float servoDegree[8];
+    // Whether the start light is on, and the simulated time it came on (microseconds).
+    extern bool startLight;
+    extern unsigned long long startLightMicros;
+    // Simulated time a drive motor was first commanded after the start light came on, 0 until then.
+    extern unsigned long long firstMoveMicros;
+    // Whether RPS is running (InitializeTouchMenu() has been called).
+    extern bool rpsOn;
+    // Total inches each wheel has rolled, and milliseconds spent pushed against a wall.
+    extern float leftTravel, rightTravel;
+    extern unsigned long blockedMillis;
+    // Which course tasks have been done.
+    extern bool taskDone[NUM_SIM_TASKS];
+
+    // Puts everything back to power on, with config as given. Hooks the world onto the simulated clock.
+    void reset(const Config &newConfig);
+    // Defaults for config.
+    Config defaults();
+    // Steps the physics up to the current simulated time.
+    void step();
+    // Picks the robot up and puts it down somewhere else, wheels stopped.
+    void place(float newX, float newY, float newHeading);
+    // Turns the start light on at a simulated time from now.
+    void startLightIn(double seconds);
+
+    // Battery voltage right now, with the sag from the motors, and a noisy reading of it.
+    float batteryVolts();
+    float batteryReading();
+
+    // Latest RPS frame, as FEHRPS hands it out. -1 for all three before RPS is running.
+    float rpsX();
+    float rpsY();
+    float rpsHeading();
+
+    // Name of a course task.
+    const char *taskName(int task);
+
+    // Voltage of the CdS cell, and of an optosensor a given distance to the left (negative is right) of center that
+    // reads offTape and onTape with its spot all off and all on the tape.
+    float cdsVolts();
+    float optoVolts(float lateral, float offTape, float onTape);
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+    Per task times and success out of run logs, for the task models in main.cpp (see planner.h).
+
+    Usage: taskTimes run000.log [run001.log ...]
+    Goes through the LOG_MISSION records of every log given. For each task it prints how many runs tried it, how
+    often its steps all worked, and the mean seconds it took, split into the approach (the steps up to and
+    including its first travel or route, if it starts with one) and the work once there. The work column is what goes in
+    TaskModel::seconds, the planner estimates the approach from the waypoints itself.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "logRecords.h"
+#include "mission.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s runNNN.log [runNNN.log ...]\n", argv[0]);
+        return 1;
+    }
+    int runs[NUM_TASKS], clean[NUM_TASKS];
+    double approach[NUM_TASKS], work[NUM_TASKS];
+    for (int task = 0; task < NUM_TASKS; task++)
+    {
+        runs[task] = 0;
+        clean[task] = 0;
+        approach[task] = 0.0;
+        work[task] = 0.0;
+    }
+
+    for (int file = 1; file < argc; file++)
+    {
+        FILE *in = fopen(argv[file], "r");
+        if (in == NULL)
+        {
+            perror(argv[file]);
+            continue;
+        }
+        // Per task for this run: seen at all, every step worked, still in its approach, and the seconds of the
+        // approach so far (only counted as approach once it gets to a travel or route).
+        bool seen[NUM_TASKS], allWorked[NUM_TASKS], approaching[NUM_TASKS];
+        double pending[NUM_TASKS];
+        for (int task = 0; task < NUM_TASKS; task++)
+        {
+            seen[task] = false;
+            allWorked[task] = true;
+            approaching[task] = false;
+            pending[task] = 0.0;
+        }
+        char line[256];
+        LogRecord record;
+        while (fgets(line, sizeof(line), in) != NULL)
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (!unpackRecord(line, record) || record.type != LOG_MISSION)
+            {
+                continue;
+            }
+            int task = (int)record.v[0], op = (int)record.v[1];
+            if (task < 0 || task >= NUM_TASKS)
+            {
+                continue;
+            }
+            if (!seen[task])
+            {
+                seen[task] = true;
+                runs[task]++;
+                approaching[task] = true;
+            }
+            if (record.v[2] != 1.0)
+            {
+                allWorked[task] = false;
+            }
+            if (approaching[task] && (op == STEP_TRAVEL || op == STEP_ROUTE))
+            {
+                approach[task] += pending[task] + record.v[4];
+                approaching[task] = false;
+            }
+            else if (approaching[task] && (op == STEP_VIA || op == STEP_FACE || op == STEP_LISTEN))
+            {
+                pending[task] += record.v[4];
+            }
+            else
+            {
+                // Got to work without a travel or route first, so there was no approach.
+                work[task] += record.v[4];
+                if (approaching[task])
+                {
+                    work[task] += pending[task];
+                    approaching[task] = false;
+                }
+            }
+        }
+        fclose(in);
+        for (int task = 0; task < NUM_TASKS; task++)
+        {
+            if (seen[task] && allWorked[task])
+            {
+                clean[task]++;
+            }
+        }
+    }
+
+    printf("%-10s %5s %7s %9s %7s\n", "task", "runs", "worked", "approach", "work");
+    for (int task = 0; task < NUM_TASKS; task++)
+    {
+        if (runs[task] == 0)
+        {
+            continue;
+        }
+        printf("%-10s %5d %6.1f%% %8.2fs %6.2fs\n", missionTaskName(task), runs[task], 100.0 * clean[task] / runs[task],
+               approach[task] / runs[task], work[task] / runs[task]);
+    }
+    return 0;
+}
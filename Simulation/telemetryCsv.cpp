@@ -0,0 +1,90 @@
+/*
+    Splits a telemetry file from the SD card (tlmNNN.txt, written by Telemetry) into one CSV per segment, for
+    graphing counts vs time in MATLAB or a spreadsheet.
+
+    Usage: telemetryCsv tlm007.txt [prefix]
+    Writes <prefix>seg001_driveForward.csv, <prefix>seg002_turn.csv, ... (prefix defaults to the input name
+    without .txt plus an underscore). Time in each file starts at 0 at the start of the segment.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "logRecords.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s tlmNNN.txt [prefix]\n", argv[0]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "r");
+    if (in == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    char prefix[256];
+    if (argc > 2)
+    {
+        snprintf(prefix, sizeof(prefix), "%s", argv[2]);
+    }
+    else
+    {
+        snprintf(prefix, sizeof(prefix), "%s", argv[1]);
+        char *dot = strrchr(prefix, '.');
+        if (dot != NULL)
+        {
+            *dot = '\0';
+        }
+        strncat(prefix, "_", sizeof(prefix) - strlen(prefix) - 1);
+    }
+
+    FILE *out = NULL;
+    // Segment numbers wrap at 256 on the robot, so a new file starts whenever the number changes.
+    int currentSegment = -1, segmentFiles = 0, samples = 0, bad = 0;
+    unsigned long startMicros = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        int segment, primitive, left, right, leftCommand, rightCommand, x, y, heading;
+        unsigned long micros;
+        if (sscanf(line, "%d %d %lu %d %d %d %d %d %d %d", &segment, &primitive, &micros, &left, &right,
+                   &leftCommand, &rightCommand, &x, &y, &heading) != 10)
+        {
+            bad++;
+            continue;
+        }
+        if (segment != currentSegment || out == NULL)
+        {
+            if (out != NULL)
+            {
+                fclose(out);
+            }
+            segmentFiles++;
+            char name[320];
+            snprintf(name, sizeof(name), "%sseg%03d_%s.csv", prefix, segmentFiles, logPrimitiveName(primitive));
+            out = fopen(name, "w");
+            if (out == NULL)
+            {
+                perror(name);
+                fclose(in);
+                return 1;
+            }
+            fprintf(out, "seconds,left_counts,right_counts,left_command,right_command,rps_x,rps_y,rps_heading\n");
+            currentSegment = segment;
+            startMicros = micros;
+        }
+        fprintf(out, "%.4f,%d,%d,%d,%d,%.2f,%.2f,%.1f\n", ((micros - startMicros) & 0xffffffffUL) / 1000000.0, left,
+                right, leftCommand, rightCommand, x / 100.0, y / 100.0, heading / 10.0);
+        samples++;
+    }
+    if (out != NULL)
+    {
+        fclose(out);
+    }
+    fclose(in);
+    fprintf(stderr, "%d samples in %d segments, %d bad lines skipped\n", samples, segmentFiles, bad);
+    return 0;
+}